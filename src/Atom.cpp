@@ -0,0 +1,68 @@
+// Copyright 2015 by Intigua, Inc.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "PyVM/Atom.h"
+
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+namespace {
+
+// node based so the key strings and the atoms never move after they are inserted
+struct AtomTable {
+	std::shared_timed_mutex                 mutex; // lookups share it, only adding an atom takes it alone
+	std::unordered_map<std::string, Atom *> atoms;
+	size_t                                  bytes = 0;
+};
+
+// never destroyed so that names used by static destructors stay valid
+AtomTable &atomTable() {
+	static AtomTable *t = new AtomTable;
+	return *t;
+}
+
+}
+
+const Atom *Atom::intern(const std::string &s) {
+	const Atom *a = find(s);
+	if (a != nullptr)
+		return a;
+	AtomTable                              &t = atomTable();
+	std::lock_guard<std::shared_timed_mutex> lock(t.mutex);
+	auto                                    it = t.atoms.find(s);
+	if (it != t.atoms.end()) // added since the lookup
+		return it->second;
+	it = t.atoms.emplace(s, nullptr).first;
+	it->second = new Atom(&it->first, std::hash<std::string>()(s));
+	t.bytes += sizeof(Atom) + sizeof(*it) + s.size() + 1;
+	return it->second;
+}
+
+const Atom *Atom::find(const std::string &s) {
+	AtomTable                                &t = atomTable();
+	std::shared_lock<std::shared_timed_mutex> lock(t.mutex);
+	auto                        it = t.atoms.find(s);
+	return (it == t.atoms.end()) ? nullptr : it->second;
+}
+
+size_t Atom::count() {
+	AtomTable                                &t = atomTable();
+	std::shared_lock<std::shared_timed_mutex> lock(t.mutex);
+	return t.atoms.size();
+}
+
+size_t Atom::bytes() {
+	AtomTable                                &t = atomTable();
+	std::shared_lock<std::shared_timed_mutex> lock(t.mutex);
+	return t.bytes;
+}
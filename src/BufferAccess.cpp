@@ -9,6 +9,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 #include "PyVM/BufferAccess.h"
+#include <algorithm>
 #include <cstring>
 
 #define CATCH_ACCESS_VIOLATION(func)                                        \
@@ -199,3 +200,54 @@ ClassObjRef BufferBuilder::addToModule(const ModuleObjRef &mod) {
 	cls->def(&BufferBuilder::str, "str");
 	return cls;
 }
+
+//---------------------------------------------------------------------------------------------
+
+StrObject *StringBuilder::buf() {
+	if (m_str.isNull()) {
+		m_str = m_vm->alloct(new StrObject);
+	} else if (m_str.use_count() != 1) { // someone got it from getvalue()
+		std::string v;
+		v.reserve(std::max(m_str->v.capacity(), m_str->v.size() * 2));
+		v.append(m_str->v);
+		m_str = m_vm->alloct(new StrObject(std::move(v)));
+	}
+	m_str->changed();
+	return m_str.get();
+}
+
+void StringBuilder::append(const ObjRef &s) {
+	// if s is the buffer itself it's referenced twice, so buf() moves to a new buffer and s stays valid
+	StrObject *b      = buf();
+	size_t     before = b->payloadSize();
+	b->v += checked_cast<StrObject>(s)->v;
+	b->payloadChanged(before);
+}
+
+void StringBuilder::reserve(int sz) {
+	StrObject *b      = buf();
+	size_t     before = b->payloadSize();
+	b->v.reserve(sz);
+	b->payloadChanged(before);
+}
+
+int StringBuilder::size() {
+	return m_str.isNull() ? 0 : (int)m_str->v.size();
+}
+
+ObjRef StringBuilder::getvalue() {
+	if (m_str.isNull())
+		m_str = m_vm->alloct(new StrObject);
+	return ObjRef(m_str);
+}
+
+ClassObjRef StringBuilder::addToModule(const ModuleObjRef &mod) {
+	auto cls = mod->class_<StringBuilder>("StringBuilder", CtorDef<NoType>());
+
+	cls->def(&StringBuilder::append, "append");
+	cls->def(&StringBuilder::append, "write");
+	cls->def(&StringBuilder::reserve, "reserve");
+	cls->def(&StringBuilder::size, "size");
+	cls->def(&StringBuilder::getvalue, "getvalue");
+	return cls;
+}
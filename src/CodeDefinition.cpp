@@ -12,52 +12,105 @@
 #include "PyVM/CodeDefinition.h"
 #include "PyVM/objects.h"
 
+#include <cstring>
+#include <iterator>
+#include <map>
+
+// reads marshal data in place. the data needs to stay valid while it is parsed, objects never point into it
 class Deserialize {
 public:
-	Deserialize(std::istream &ins)
-		: m_in(ins) {}
+	Deserialize(const char *data, size_t size)
+		: m_begin(data), m_p(data), m_end(data + size) {}
+	// marshal is little endian, like all the hosts the vm runs on
 	template <typename T>
 	T read() {
 		T v;
-		m_in.read((char *)&v, sizeof(T));
+		memcpy(&v, take(sizeof(T)), sizeof(T));
 		return v;
 	}
-	std::string readStr(uint count) {
-		std::string s;
-		s.resize(count);
-		m_in.read((char *)s.data(), count);
-		return s;
+	// the next count bytes
+	const char *take(size_t count) {
+		CHECK((size_t)(m_end - m_p) >= count, "Unexpected end of marshal data at " << offset());
+		const char *p = m_p;
+		m_p += count;
+		return p;
+	}
+	uchar peek() const {
+		CHECK(m_p < m_end, "Unexpected end of marshal data at " << offset());
+		return (uchar)*m_p;
 	}
 
 	std::vector<ObjRef> m_internedStr;
 	int                 offset() const {
-        return (int)m_in.tellg();
+        return (int)(m_p - m_begin);
 	}
 
+	// set while parsing co_consts. constants are immortal and equal constants in a vm are the same object, see ConstTable
+	bool m_inConsts = false;
+
 private:
-	std::istream &m_in;
+	const char *m_begin, *m_p, *m_end;
 };
 
 ObjRef parseNext(Deserialize &s, PyVM *vm);
 
+// a constant while parsing co_consts, a new object otherwise
+static ObjRef makeInt(Deserialize &s, PyVM *vm, int64_t v) {
+	return s.m_inConsts ? vm->constants().intConst(v) : vm->makeFromT(v);
+}
+
+static ObjRef makeFloat(Deserialize &s, PyVM *vm, double v) {
+	return s.m_inConsts ? vm->constants().floatConst(v) : vm->makeFromT(v);
+}
+
+// a str made directly from the next sz bytes of the data. a constant str is copied only if the vm doesn't have it yet
+static ObjRef makeStr(Deserialize &s, PyVM *vm, uint sz) {
+	ConstTable::Bytes b{s.take(sz), sz};
+	if (s.m_inConsts)
+		return vm->constants().strConst(b);
+	return vm->alloc(new StrObject(std::string(b.p, b.n)));
+}
+
+// a str field of a code object, copied once from the data into the field
+static std::string parseStrField(Deserialize &s, PyVM *vm) {
+	if (s.peek() != 's')
+		return extract<std::string>(parseNext(s, vm));
+	s.read<uchar>();
+	uint sz = s.read<uint>();
+	return std::string(s.take(sz), sz);
+}
+
+// the items of co_consts are constants, the tuple that holds them is not kept
+static std::vector<ObjRef> parseConsts(Deserialize &s, PyVM *vm) {
+	uchar t = s.read<uchar>();
+	CHECK(t == '(', "Unexpected co_consts type `" << t << "`");
+	std::vector<ObjRef> consts(s.read<uint>());
+	bool                outer = s.m_inConsts;
+	s.m_inConsts              = true;
+	for (auto &c : consts)
+		c = parseNext(s, vm);
+	s.m_inConsts = outer;
+	return consts;
+}
+
 // http://daeken.com/2010-02-20_Python_Marshal_Format.html
 void CodeDefinition::parseCode(Deserialize &s, PyVM *vm) {
 	co_argcount  = s.read<uint>();
 	co_nlocals   = s.read<uint>();
 	co_stacksize = s.read<uint>();
 	co_flags     = s.read<uint>();
-	co_code      = extract<std::string>(parseNext(s, vm));
-	co_consts    = extract<std::vector<ObjRef>>(parseNext(s, vm));
+	co_code      = parseStrField(s, vm);
+	co_consts    = parseConsts(s, vm);
 
-	co_names    = extract<std::vector<std::string>>(parseNext(s, vm));
-	co_varnames = extract<std::vector<std::string>>(parseNext(s, vm));
+	co_names    = extract<std::vector<Name>>(parseNext(s, vm));
+	co_varnames = extract<std::vector<Name>>(parseNext(s, vm));
 	co_freevars = extract<std::vector<std::string>>(parseNext(s, vm));
 	co_cellvars = extract<std::vector<std::string>>(parseNext(s, vm));
 	co_filename = extract<std::string>(parseNext(s, vm));
 	co_name     = extract<std::string>(parseNext(s, vm));
 
 	co_firstlineno = s.read<uint>();
-	co_lnotab      = extract<std::string>(parseNext(s, vm));
+	co_lnotab      = parseStrField(s, vm);
 }
 
 ObjRef parseNext(Deserialize &s, PyVM *vm) {
@@ -73,37 +126,46 @@ ObjRef parseNext(Deserialize &s, PyVM *vm) {
 	case 'T':
 		return vm->makeFromT(true);
 	case 'i':
-		return vm->makeFromT(s.read<int>());
+		return makeInt(s, vm, s.read<int>());
 	case 'I':
-		return vm->makeFromT(s.read<int64_t>());
+		return makeInt(s, vm, s.read<int64_t>());
 	case 'g':
-		return vm->makeFromT(s.read<double>());
-	case 's': {
-		uint sz = s.read<uint>();
-		return vm->makeFromT(s.readStr(sz));
-	}
+		return makeFloat(s, vm, s.read<double>());
+	case 's':
+		return makeStr(s, vm, s.read<uint>());
 	case '(':
 	case '[': {
-		uint        sz  = s.read<uint>();
-		ListObject *obj = (t == '(') ? new TupleObject : new ListObject;
-		obj->v.resize(sz);
-		for (uint i = 0; i < sz; ++i)
-			obj->v[i] = parseNext(s, vm);
-		return vm->alloc(obj);
+		uint                        sz = s.read<uint>();
+		std::unique_ptr<ListObject> obj((t == '(') ? new TupleObject : new ListObject); // freed if the data is bad
+		auto &items = obj->objects();
+		items.resize(sz);
+		bool immortal = s.m_inConsts && t == '(';
+		for (uint i = 0; i < sz; ++i) {
+			items[i] = parseNext(s, vm);
+			immortal &= !items[i].isNull() && items[i]->count.immortal();
+		}
+		if (!immortal)
+			return vm->alloc(obj.release());
+		return vm->constants().tupleConst(std::move(obj));
 	}
 	case 'c': {
-		auto *co = new CodeObject;
+		std::unique_ptr<CodeObject> co(new CodeObject);
+		bool                        outer = s.m_inConsts;
+		s.m_inConsts                      = false; // only the consts of the code object itself
 		co->m_co.parseCode(s, vm);
-		return vm->alloc(co);
+		s.m_inConsts = outer;
+		return vm->alloc(co.release());
 	}
 	case 't': { // interned str
-		uint   sz  = s.read<uint>();
-		ObjRef obj = vm->makeFromT(s.readStr(sz));
+		ObjRef obj = makeStr(s, vm, s.read<uint>());
 		s.m_internedStr.push_back(obj);
 		return obj;
 	}
-	case 'R':
-		return s.m_internedStr[s.read<int>()];
+	case 'R': {
+		uint i = s.read<uint>();
+		CHECK(i < s.m_internedStr.size(), "Bad interned string reference " << i);
+		return s.m_internedStr[i];
+	}
 	case 'l': {                       // long, encoded as digits in base 2^15
 		int     h   = s.read<uint>(); // number of digits, sign is the sign of the number
 		int     sz  = std::abs(h);
@@ -114,13 +176,15 @@ ObjRef parseNext(Deserialize &s, PyVM *vm) {
 			res |= (int64_t)b << pos;
 			pos += 15;
 		}
-		return vm->makeFromT(h < 0 ? -res : res);
+		return makeInt(s, vm, h < 0 ? -res : res);
 	}
 	case 'u': { // utf8 unicode
 		uint         sz = s.read<uint>();
 		std::wstring us;
-		CHECK(wstrFromUtf8(s.readStr(sz), &us), "Failed reading UTF8");
-		return vm->makeFromT(us);
+		CHECK(wstrFromUtf8(std::string(s.take(sz), sz), &us), "Failed reading UTF8");
+		if (s.m_inConsts)
+			return vm->constants().ustrConst(std::move(us));
+		return vm->makeFromT(std::move(us));
 	}
 	case '{':
 	case '>':
@@ -134,12 +198,27 @@ ObjRef parseNext(Deserialize &s, PyVM *vm) {
 	}
 }
 
-ObjRef CodeDefinition::parsePyc(std::istream &iss, PyVM *vm, bool hasHeadr) {
-	Deserialize d(iss);
-	if (hasHeadr) {
-		uint magic = d.read<uint>();
-		CHECK(magic == 0x0a0df303, "Unexpected magic number in marshal format " << std::hex << magic);
-		uint timestamp = d.read<uint>();
+ObjRef CodeDefinition::parsePyc(std::istream &iss, PyVM *vm, bool hasHeader) {
+	std::string data((std::istreambuf_iterator<char>(iss)), std::istreambuf_iterator<char>());
+	return parsePyc(data.data(), data.size(), vm, hasHeader);
+}
+
+ObjRef CodeDefinition::parsePyc(const char *data, size_t size, PyVM *vm, bool hasHeadr) {
+	size_t mark = vm->constants().mark();
+	try {
+		// in here so that its references to parsed objects are gone before a rollback
+		Deserialize d(data, size);
+		if (hasHeadr) {
+			uint magic = d.read<uint>();
+			CHECK(magic == 0x0a0df303, "Unexpected magic number in marshal format " << std::hex << magic);
+			uint timestamp = d.read<uint>();
+		}
+		return parseNext(d, vm);
+	}
+	catch (...) {
+		// what was parsed is released by now. delete it so no object references the constants that are taken back
+		vm->objPool().drain();
+		vm->constants().rollback(mark);
+		throw;
 	}
-	return parseNext(d, vm);
 }
@@ -0,0 +1,113 @@
+// Copyright 2015 by Intigua, Inc.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "PyVM/ConstTable.h"
+#include "PyVM/objects.h"
+
+#include <cstring>
+
+static uint64_t floatBits(double v) {
+	uint64_t bits;
+	memcpy(&bits, &v, sizeof(v));
+	return bits;
+}
+
+static std::vector<Object *> tupleKey(ListObject *t) {
+	std::vector<Object *> key;
+	for (const auto &o : t->objects())
+		key.push_back(o.get());
+	return key;
+}
+
+bool ConstTable::Bytes::operator<(const Bytes &o) const {
+	int c = memcmp(p, o.p, std::min(n, o.n));
+	return c < 0 || (c == 0 && n < o.n);
+}
+
+ConstTable::~ConstTable() {
+	while (!m_objs.empty())
+		m_objs.pop_back();
+}
+
+// charged after it's in the table, so if that throws a MemoryError the rollback of the parse frees it
+ObjRef ConstTable::add(Object *o) {
+	o->count.count = RefCount<Object>::IMMORTAL;
+	m_objs.emplace_back(o);
+	m_charged.push_back(o->objectSize() + o->payloadSize());
+	m_pool->addBytes(m_charged.back());
+	return ObjRef(o);
+}
+
+ObjRef ConstTable::intConst(int64_t v) {
+	Object *&c = m_ints[v];
+	if (c == nullptr)
+		c = add(new IntObject(v)).get();
+	return ObjRef(c);
+}
+
+ObjRef ConstTable::floatConst(double v) {
+	Object *&c = m_floats[floatBits(v)];
+	if (c == nullptr)
+		c = add(new FloatObject(v)).get();
+	return ObjRef(c);
+}
+
+ObjRef ConstTable::strConst(const Bytes &v) {
+	auto it = m_strs.find(v);
+	if (it != m_strs.end())
+		return ObjRef(it->second);
+	auto *s = new StrObject(std::string(v.p, v.n));
+	m_strs[Bytes{s->v.data(), s->v.size()}] = s;
+	return add(s);
+}
+
+ObjRef ConstTable::ustrConst(std::wstring &&v) {
+	auto it = m_ustrs.find(v);
+	if (it != m_ustrs.end())
+		return ObjRef(it->second);
+	auto *s = new UnicodeObject(std::move(v));
+	m_ustrs[s->v] = s;
+	return add(s);
+}
+
+ObjRef ConstTable::tupleConst(std::unique_ptr<ListObject> t) {
+	Object *&c = m_tuples[tupleKey(t.get())];
+	if (c == nullptr)
+		c = add(t.release()).get();
+	return ObjRef(c);
+}
+
+void ConstTable::rollback(size_t mark) {
+	while (m_objs.size() > mark) {
+		Object *o = m_objs.back().get();
+		switch (o->type()) {
+		case Object::INT:
+			m_ints.erase(static_cast<IntObject *>(o)->v);
+			break;
+		case Object::FLOAT:
+			m_floats.erase(floatBits(static_cast<FloatObject *>(o)->v));
+			break;
+		case Object::STR: {
+			const std::string &s = static_cast<StrObject *>(o)->v;
+			m_strs.erase(Bytes{s.data(), s.size()});
+			break;
+		}
+		case Object::USTR:
+			m_ustrs.erase(static_cast<UnicodeObject *>(o)->v);
+			break;
+		default:
+			m_tuples.erase(tupleKey(static_cast<ListObject *>(o)));
+		}
+		m_pool->addBytes(-(int64_t)m_charged.back());
+		m_charged.pop_back();
+		m_objs.pop_back();
+	}
+}
@@ -0,0 +1,117 @@
+// Copyright 2015 by Intigua, Inc.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "PyVM/CycleCollector.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+int freeUnreachable(const std::vector<Object *> &objs) {
+	std::unordered_map<Object *, int> index;
+	for (size_t i = 0; i < objs.size(); ++i)
+		index[objs[i]] = (int)i;
+
+	// subtract the references objects in the group hold to each other. what remains are references from outside
+	std::vector<int> outsideRefs(objs.size());
+	for (size_t i = 0; i < objs.size(); ++i)
+		outsideRefs[i] = objs[i]->count.count;
+	for (Object *o : objs) {
+		o->traverse([&](Object *c) {
+			auto it = index.find(c);
+			if (it != index.end())
+				--outsideRefs[it->second];
+		});
+	}
+
+	// everything that is reachable from an object referenced from outside is alive
+	std::vector<bool>     reachable(objs.size(), false);
+	std::vector<Object *> work;
+	for (size_t i = 0; i < objs.size(); ++i) {
+		if (outsideRefs[i] > 0) {
+			reachable[i] = true;
+			work.push_back(objs[i]);
+		}
+	}
+	while (!work.empty()) {
+		Object *o = work.back();
+		work.pop_back();
+		o->traverse([&](Object *c) {
+			auto it = index.find(c);
+			if (it != index.end() && !reachable[it->second]) {
+				reachable[it->second] = true;
+				work.push_back(c);
+			}
+		});
+	}
+
+	// hold on to all the garbage while breaking its cycles so nothing is freed in the middle, then free it all at once
+	std::vector<ObjRef> garbage;
+	for (size_t i = 0; i < objs.size(); ++i) {
+		if (!reachable[i])
+			garbage.push_back(ObjRef(objs[i]));
+	}
+	for (const auto &o : garbage)
+		o->clear();
+	int count = (int)garbage.size();
+	garbage.clear();
+	return count;
+}
+
+// only objects that hold references can be part of a cycle
+static bool isContainer(Object::Type t) {
+	switch (t) {
+	case Object::TUPLE:
+	case Object::LIST:
+	case Object::DICT:
+	case Object::STRDICT:
+	case Object::MODULE:
+	case Object::FUNC:
+	case Object::CLASS:
+	case Object::INSTANCE:
+	case Object::METHOD:
+	case Object::ITERATOR:
+	case Object::PRIMITIVE_ADAPTER:
+	case Object::GENERATOR:
+		return true;
+	default:
+		return false;
+	}
+}
+
+int CycleCollector::collect() {
+	std::vector<Object *> objs;
+	m_pool.foreach ([&](const ObjRef &o) -> bool {
+		if (isContainer(o->type()))
+			objs.push_back(o.get());
+		return true;
+	});
+	int before = m_pool.size();
+	freeUnreachable(objs);
+	return before - m_pool.size();
+}
+
+int CycleCollector::step(int maxObjects) {
+	std::vector<Object *> objs;
+	int                   visited = 0;
+	m_pool.foreachSince(m_cursor, [&](const ObjRef &o) -> bool {
+		if (isContainer(o->type()))
+			objs.push_back(o.get());
+		return ++visited < maxObjects;
+	});
+	int before = m_pool.size();
+	freeUnreachable(objs);
+	int freed = before - m_pool.size();
+
+	// the next window starts in the middle of this one. what was freed is no longer there to skip over
+	if (visited < maxObjects || !m_pool.advance(m_cursor, std::max(1, (visited - freed) / 2)))
+		m_pool.rewind(m_cursor);
+	return freed;
+}
@@ -0,0 +1,228 @@
+// Copyright 2015 by Intigua, Inc.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "PyVM/GlobMatcher.h"
+#include "PyVM/PyVM.h"
+
+#include <algorithm>
+
+using TChildren = std::vector<std::pair<std::wstring, int>>;
+
+// calls f(begin, end) for every component of the path p
+template <typename F>
+static void forComponents(const std::wstring &p, F f) {
+	size_t b = 0;
+	while (true) {
+		size_t e = p.find(L'/', b);
+		if (e == std::wstring::npos) {
+			f(p.data() + b, p.data() + p.size());
+			return;
+		}
+		f(p.data() + b, p.data() + e);
+		b = e + 1;
+	}
+}
+
+// does c match the [...] class that starts after the '[' at *pp. advances *pp past the ']'.
+// returns false in *valid if there is no closing ']', then the '[' is just a character
+static bool matchClass(const wchar_t **pp, const wchar_t *pe, wchar_t c, bool *valid) {
+	const wchar_t *p      = *pp;
+	bool           negate = p < pe && (*p == '!' || *p == '^');
+	if (negate)
+		++p;
+	bool found = false;
+	for (bool first = true; p < pe && (*p != ']' || first); first = false) {
+		wchar_t lo = *p++, hi = lo;
+		if (p + 1 < pe && *p == '-' && p[1] != ']') {
+			hi = p[1];
+			p += 2;
+		}
+		found |= lo <= c && c <= hi;
+	}
+	*valid = p < pe;
+	if (*valid)
+		*pp = p + 1;
+	return found != negate;
+}
+
+// glob match of a single path component, backtracks only to the last '*'
+static bool componentMatch(const wchar_t *p, const wchar_t *pe, const wchar_t *s, const wchar_t *se) {
+	const wchar_t *starP = nullptr, *starS = nullptr;
+	while (s < se) {
+		if (p < pe && *p == '*') {
+			starP = ++p;
+			starS = s;
+			continue;
+		}
+		if (p < pe) {
+			const wchar_t *next = p + 1;
+			bool           ok;
+			if (*p == '?') {
+				ok = true;
+			} else if (*p == '[') {
+				bool valid;
+				ok = matchClass(&next, pe, *s, &valid);
+				if (!valid) {
+					next = p + 1;
+					ok   = *s == '[';
+				}
+			} else {
+				ok = *p == *s;
+			}
+			if (ok) {
+				p = next;
+				++s;
+				continue;
+			}
+		}
+		if (starP == nullptr)
+			return false;
+		p = starP;
+		s = ++starS;
+	}
+	while (p < pe && *p == '*')
+		++p;
+	return p == pe;
+}
+
+// the node of the literal component [b, b + len), -1 if there is none
+static int findLiteral(const TChildren &children, const wchar_t *b, size_t len) {
+	size_t lo = 0, hi = children.size();
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		int    c   = children[mid].first.compare(0, std::wstring::npos, b, len);
+		if (c == 0)
+			return children[mid].second;
+		if (c < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return -1;
+}
+
+static bool isGlob(const std::wstring &comp) {
+	return comp.find_first_of(L"*?[") != std::wstring::npos;
+}
+
+int GlobMatcher::child(TChildren &children, const std::wstring &comp, bool sorted) {
+	auto it = sorted ? std::lower_bound(children.begin(), children.end(), comp, [](const TChildren::value_type &c, const std::wstring &k) {
+		return c.first < k;
+	})
+					 : std::find_if(children.begin(), children.end(), [&](const TChildren::value_type &c) {
+						   return c.first == comp;
+					   });
+	if (it != children.end() && it->first == comp)
+		return it->second;
+	int n = (int)m_nodes.size();
+	children.insert(it, std::make_pair(comp, n));
+	m_nodes.emplace_back();
+	return n;
+}
+
+GlobMatcher::GlobMatcher(PyVM *vm, const ObjRef &rules)
+	: m_vm(vm), m_nodes(1) {
+	std::vector<ObjRef> rv = extract<std::vector<ObjRef>>(rules);
+	m_ruleCount            = (int)rv.size();
+	for (int ri = 0; ri < m_ruleCount; ++ri) {
+		CHECK(!rv[ri].isNull() && isStrType(rv[ri]->type()), "GlobMatcher rules need to be strings");
+		int node = 0;
+		forComponents(*extractStrPtr<wchar_t>(rv[ri], STRMOD_PATH), [&](const wchar_t *b, const wchar_t *e) {
+			std::wstring comp(b, e);
+			if (comp == L"**") {
+				if (m_nodes[node].anyDepth < 0) {
+					int n                  = (int)m_nodes.size();
+					m_nodes[node].anyDepth = n;
+					m_nodes.emplace_back();
+					m_nodes[n].isAnyDepth = true;
+				}
+				node = m_nodes[node].anyDepth;
+			} else if (isGlob(comp)) {
+				TChildren c = std::move(m_nodes[node].globs); // moved out since child() may grow m_nodes
+				int       n = child(c, comp, false);
+				m_nodes[node].globs = std::move(c);
+				node = n;
+			} else {
+				TChildren c = std::move(m_nodes[node].literals);
+				int       n = child(c, comp, true);
+				m_nodes[node].literals = std::move(c);
+				node = n;
+			}
+		});
+		m_nodes[node].rules.push_back(ri);
+	}
+}
+
+void GlobMatcher::run(const ObjRef &path, std::vector<int> *active) const {
+	CHECK(!path.isNull() && isStrType(path->type()), "GlobMatcher can only match strings");
+	std::vector<int> &cur = *active, next;
+	std::vector<int> stamp(m_nodes.size(), -1); // the step in which a node was last added, so it's added once per step
+	int              step = 0;
+	// adding a node that has a "**" child adds that child too, since "**" can match no components. -1 is no node
+	auto add = [&](std::vector<int> &to, int n) {
+		while (n >= 0 && stamp[n] != step) {
+			stamp[n] = step;
+			to.push_back(n);
+			n = m_nodes[n].anyDepth;
+		}
+	};
+	add(cur, 0);
+	forComponents(*extractStrPtr<wchar_t>(path, STRMOD_PATH), [&](const wchar_t *b, const wchar_t *e) {
+		++step;
+		next.clear();
+		for (int ni : cur) {
+			const Node &n = m_nodes[ni];
+			add(next, findLiteral(n.literals, b, e - b));
+			for (const auto &g : n.globs)
+				if (componentMatch(g.first.data(), g.first.data() + g.first.size(), b, e))
+					add(next, g.second);
+			if (n.isAnyDepth)
+				add(next, ni);
+		}
+		cur.swap(next);
+	});
+}
+
+bool GlobMatcher::matches(const ObjRef &path) {
+	return match(path) >= 0;
+}
+
+int GlobMatcher::match(const ObjRef &path) {
+	std::vector<int> active;
+	run(path, &active);
+	int first = -1;
+	for (int ni : active)
+		if (!m_nodes[ni].rules.empty() && (first < 0 || m_nodes[ni].rules[0] < first))
+			first = m_nodes[ni].rules[0];
+	return first;
+}
+
+ObjRef GlobMatcher::matchall(const ObjRef &path) {
+	std::vector<int> active, found;
+	run(path, &active);
+	for (int ni : active)
+		found.insert(found.end(), m_nodes[ni].rules.begin(), m_nodes[ni].rules.end());
+	std::sort(found.begin(), found.end());
+	ListObjRef ret = m_vm->alloct(new ListObject);
+	for (int ri : found)
+		ret->append(m_vm->makeFromT(ri));
+	return ObjRef(ret);
+}
+
+ClassObjRef GlobMatcher::addToModule(const ModuleObjRef &mod) {
+	auto cls = mod->class_<GlobMatcher>("GlobMatcher", CtorDef<ObjRef>());
+
+	cls->def(&GlobMatcher::matches, "matches");
+	cls->def(&GlobMatcher::match, "match");
+	cls->def(&GlobMatcher::matchall, "matchall");
+	cls->def(&GlobMatcher::ruleCount, "ruleCount");
+	return cls;
+}
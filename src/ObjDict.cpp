@@ -0,0 +1,144 @@
+// Copyright 2015 by Intigua, Inc.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "PyVM/ObjDict.h"
+#include "PyVM/objects.h"
+
+// the probe sequence of CPython's dictobject.c, all the bits of the hash take part after a few steps
+#define PERTURB_SHIFT 5
+
+static ObjDict::KeyKind kindOf(const ObjRef &key) {
+	if (key.isNull())
+		return ObjDict::ANY_KEYS;
+	if (key->type() == Object::INT)
+		return ObjDict::INT_KEYS;
+	if (key->type() == Object::STR)
+		return ObjDict::STR_KEYS;
+	return ObjDict::ANY_KEYS;
+}
+
+// the same as hashNum(), without its type switch for an int
+int64_t ObjDict::keyHash(const ObjRef &key) {
+	if (!key.isNull() && key->type() == Object::INT) {
+		int64_t v = static_cast<IntObject *>(key.get())->v;
+		return v == -1 ? -2 : v;
+	}
+	return hashNum(key);
+}
+
+template <typename Eq>
+size_t ObjDict::probe(int64_t hash, Eq eq) const {
+	if (m_index.empty())
+		return m_entries.size();
+	size_t   mask    = m_index.size() - 1;
+	uint64_t perturb = (uint64_t)hash;
+	for (size_t s = (size_t)hash & mask;;) {
+		int e = m_index[s];
+		if (e < 0)
+			return m_entries.size();
+		const Entry &en = m_entries[e];
+		if (en.hash == hash && !en.first.isNull() && eq(en))
+			return e;
+		perturb >>= PERTURB_SHIFT;
+		s = (s * 5 + perturb + 1) & mask;
+	}
+}
+
+size_t ObjDict::indexOf(const ObjRef &key, int64_t hash) const {
+	KeyKind kind = kindOf(key);
+	if (kind == INT_KEYS && m_keyKind == INT_KEYS) {
+		// the keys are all ints and an int is its own hash, except for -1 which hashes like -2
+		if (hash != -2)
+			return probe(hash, [](const Entry &) { return true; });
+		int64_t v = static_cast<IntObject *>(key.get())->v;
+		return probe(hash, [v](const Entry &en) { return static_cast<IntObject *>(en.first.get())->v == v; });
+	}
+	if (kind == STR_KEYS && m_keyKind == STR_KEYS) {
+		const std::string &v = static_cast<StrObject *>(key.get())->v;
+		return probe(hash, [&](const Entry &en) { return en.first.get() == key.get() || static_cast<StrObject *>(en.first.get())->v == v; });
+	}
+	return probe(hash, [&](const Entry &en) { return dictKeyEquals(en.first, key, m_vm); });
+}
+
+void ObjDict::indexEntry(size_t i) {
+	size_t   mask    = m_index.size() - 1;
+	uint64_t perturb = (uint64_t)m_entries[i].hash;
+	size_t   s       = (size_t)m_entries[i].hash & mask;
+	while (m_index[s] >= 0) {
+		perturb >>= PERTURB_SHIFT;
+		s = (s * 5 + perturb + 1) & mask;
+	}
+	m_index[s] = (int)i;
+}
+
+// drop dead entries and size the index so that it is at most 2/3 full with forSize entries
+void ObjDict::rebuild(size_t forSize) {
+	if (m_size != m_entries.size()) {
+		size_t w = 0;
+		for (size_t r = 0; r < m_entries.size(); ++r)
+			if (!m_entries[r].first.isNull())
+				m_entries[w++] = std::move(m_entries[r]);
+		m_entries.resize(w);
+	}
+	size_t cap = MIN_INDEX;
+	while (cap * 2 < forSize * 3)
+		cap *= 2;
+	m_index.assign(cap, -1);
+	for (size_t i = 0; i < m_entries.size(); ++i)
+		indexEntry(i);
+}
+
+void ObjDict::grown(size_t before) {
+	if (m_owner != nullptr)
+		ObjPool<Object>::resized(m_owner, (int64_t)payloadSize() - (int64_t)before);
+}
+
+void ObjDict::reserve(size_t n) {
+	size_t before = payloadSize();
+	m_entries.reserve(n);
+	if (m_index.size() * 2 < n * 3)
+		rebuild(n);
+	grown(before);
+}
+
+ObjRef &ObjDict::operator[](const ObjRef &key) {
+	int64_t h = keyHash(key);
+	size_t  i = indexOf(key, h);
+	if (i != m_entries.size())
+		return m_entries[i].second;
+	// the index fills with dead entries too, they are dropped on rebuild
+	size_t before = payloadSize();
+	if ((m_entries.size() + 1) * 3 > m_index.size() * 2)
+		rebuild((m_size + 1) * 2);
+	if (m_entries.size() == m_entries.capacity())
+		m_entries.reserve(std::max<size_t>(MIN_INDEX, m_entries.capacity() * 2));
+	grown(before); // the new entry is not there yet if this throws
+	m_entries.push_back(Entry{key, ObjRef(), h});
+	KeyKind kind = kindOf(key);
+	if (m_size == 0)
+		m_keyKind = kind;
+	else if (m_keyKind != kind)
+		m_keyKind = ANY_KEYS;
+	++m_size;
+	indexEntry(m_entries.size() - 1);
+	return m_entries.back().second;
+}
+
+size_t ObjDict::erase(const ObjRef &key) {
+	size_t i = indexOf(key, keyHash(key));
+	if (i == m_entries.size())
+		return 0;
+	// the index slot keeps pointing to the dead entry so that probe chains through it stay intact
+	m_entries[i].first.reset();
+	m_entries[i].second.reset();
+	--m_size;
+	return 1;
+}
@@ -0,0 +1,181 @@
+// Copyright 2015 by Intigua, Inc.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "PyVM/PatternMatcher.h"
+#include "PyVM/PyVM.h"
+
+#include <deque>
+#include <map>
+
+// the unicode code unit a str character is compared as, the same conversion wstrFromAnsi() does
+static uint32_t unitOfByte(char c) {
+	return (uint32_t)(wchar_t)c;
+}
+
+int PatternMatcher::classOf(uint32_t u) const {
+	if (u < 256)
+		return m_lowClass[u];
+	auto it = m_highClass.find(u);
+	return it == m_highClass.end() ? 0 : it->second;
+}
+
+int PatternMatcher::addClass(uint32_t u) {
+	int c = classOf(u);
+	if (c != 0)
+		return c;
+	c = m_classCount++;
+	if (u < 256)
+		m_lowClass[u] = c;
+	else
+		m_highClass[u] = c;
+	if (m_casei && u >= 'a' && u <= 'z') // the upper case letter scans into the same class
+		m_lowClass[u - ('a' - 'A')] = c;
+	return c;
+}
+
+PatternMatcher::PatternMatcher(PyVM *vm, const ObjRef &patterns, bool casei)
+	: m_vm(vm), m_casei(casei) {
+	std::fill(std::begin(m_lowClass), std::end(m_lowClass), 0);
+	m_patterns = extract<std::vector<ObjRef>>(patterns);
+
+	// the trie, with sparse transitions while it's built
+	std::vector<std::map<int, int>> trie(1);
+	m_out.resize(1);
+	for (int pi = 0; pi < (int)m_patterns.size(); ++pi) {
+		const ObjRef &p = m_patterns[pi];
+		CHECK(!p.isNull() && isStrType(p->type()), "compile_patterns() patterns need to be strings");
+		std::vector<uint32_t> units;
+		if (p->type() == Object::STR) {
+			for (char c : static_cast<StrObject *>(p.get())->v)
+				units.push_back(fold(unitOfByte(c)));
+		} else {
+			for (wchar_t c : static_cast<UnicodeObject *>(p.get())->v)
+				units.push_back(fold((uint32_t)c));
+		}
+		CHECK(!units.empty(), "compile_patterns() patterns can't be empty");
+		int state = 0;
+		for (uint32_t u : units) {
+			int  c  = addClass(u);
+			auto it = trie[state].find(c);
+			if (it != trie[state].end()) {
+				state = it->second;
+				continue;
+			}
+			trie[state][c] = (int)trie.size();
+			state          = (int)trie.size();
+			trie.emplace_back();
+			m_out.emplace_back();
+		}
+		m_out[state].push_back(pi);
+	}
+	for (int b = 0; b < 256; ++b)
+		m_byteClass[b] = classOf(fold(unitOfByte((char)b)));
+
+	// breadth first, a state's failure state is always done before it. every missing transition takes
+	// the transition of the failure state, so scanning never follows failure links
+	m_delta.assign(trie.size() * m_classCount, 0);
+	std::vector<int> fail(trie.size(), 0);
+	std::deque<int>  queue;
+	for (const auto &t : trie[0]) {
+		m_delta[t.first] = t.second;
+		queue.push_back(t.second);
+	}
+	while (!queue.empty()) {
+		int s = queue.front();
+		queue.pop_front();
+		const int *failRow = &m_delta[fail[s] * m_classCount];
+		int       *row     = &m_delta[s * m_classCount];
+		for (int c = 0; c < m_classCount; ++c)
+			row[c] = failRow[c];
+		for (const auto &t : trie[s]) {
+			row[t.first]    = t.second;
+			fail[t.second]  = failRow[t.first];
+			const auto &fo  = m_out[fail[t.second]];
+			m_out[t.second].insert(m_out[t.second].end(), fo.begin(), fo.end());
+			queue.push_back(t.second);
+		}
+	}
+}
+
+template <typename F>
+void PatternMatcher::scan(const ObjRef &s, F f) const {
+	CHECK(!s.isNull() && isStrType(s->type()), "matcher input needs to be a string");
+	int state = 0;
+	if (s->type() == Object::STR) {
+		const std::string &v = static_cast<StrObject *>(s.get())->v;
+		for (size_t i = 0; i < v.size(); ++i) {
+			state = m_delta[state * m_classCount + m_byteClass[(unsigned char)v[i]]];
+			if (!m_out[state].empty() && !f(i + 1, state))
+				return;
+		}
+	} else {
+		const std::wstring &v = static_cast<UnicodeObject *>(s.get())->v;
+		for (size_t i = 0; i < v.size(); ++i) {
+			state = m_delta[state * m_classCount + classOf(fold((uint32_t)v[i]))];
+			if (!m_out[state].empty() && !f(i + 1, state))
+				return;
+		}
+	}
+}
+
+bool PatternMatcher::matches(const ObjRef &s) {
+	bool found = false;
+	scan(s, [&](size_t, int) {
+		found = true;
+		return false;
+	});
+	return found;
+}
+
+ObjRef PatternMatcher::search(const ObjRef &s) {
+	ObjRef found;
+	scan(s, [&](size_t, int state) {
+		found = m_patterns[m_out[state][0]];
+		return false;
+	});
+	return found.isNull() ? m_vm->makeNone() : found;
+}
+
+ObjRef PatternMatcher::findall(const ObjRef &s) {
+	ListObjRef ret = m_vm->alloct(new ListObject);
+	scan(s, [&](size_t end, int state) {
+		for (int pi : m_out[state]) {
+			const ObjRef &p = m_patterns[pi];
+			ret->append(m_vm->makeTuple((int)(end - static_cast<StrBaseObject *>(p.get())->size()), p));
+		}
+		return true;
+	});
+	return ObjRef(ret);
+}
+
+ClassObjRef PatternMatcher::addToModule(const ModuleObjRef &mod) {
+	auto cls = mod->class_<PatternMatcher>("PatternMatcher", CtorDef<ObjRef>());
+
+	cls->def(&PatternMatcher::matches, "matches");
+	cls->def(&PatternMatcher::search, "search");
+	cls->def(&PatternMatcher::findall, "findall");
+	cls->def(&PatternMatcher::patternCount, "patternCount");
+
+	// compile_patterns(patterns, casei=False)
+	// the class is owned by the module, which outlives the function. a reference would be a cycle
+	ClassObject *c  = cls.get();
+	PyVM        *vm = mod->m_vm;
+	mod->defIc("compile_patterns", makeWrap<-1>(vm, [c, vm](CallArgs &args) -> ObjRef {
+		args.posReverse();
+		CHECK(args.pos.size() == 1 || args.pos.size() == 2, "compile_patterns() takes the patterns and an optional casei flag");
+		bool   casei = args.pos.size() == 2 && extract<bool>(args[1]);
+		ObjRef kw    = tryLookup(args.kw, "casei");
+		if (!kw.isNull())
+			casei = extract<bool>(kw);
+		return ObjRef(c->instanceSharedPtr(std::make_shared<PatternMatcher>(vm, args[0], casei)));
+	}));
+	return cls;
+}
@@ -9,13 +9,15 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include "PyVM/BufferAccess.h"
+#include "PyVM/GlobMatcher.h"
+#include "PyVM/PatternMatcher.h"
 #include "PyVM/PyCompile.h"
 #include "PyVM/PyVM.h"
 #include "PyVM/log.h"
 #include "PyVM/objects.h"
 #include "PyVM/utils.h"
 
-#include <fstream>
 #include <sstream>
 
 // int g_maxStackSize;
@@ -26,9 +28,8 @@ template ObjRef PyVM::makeFromT(const PoolPtr<Object> &v);
 
 void Frame::argsFromStack(Frame &from, int posCount, int kwCount, CallArgs &args) {
 	for (int i = 0; i < kwCount; ++i) {
-		ObjRef v                         = from.pop();
-		ObjRef k                         = from.pop();
-		args.kw[extract<std::string>(k)] = v;
+		ObjRef v                                    = from.pop();
+		args.kw[m_vm->name(extract<std::string>(from.pop()))] = std::move(v);
 	}
 	args.pos.reserve(posCount + 1); // avoid push_back allocating - all positional args + possible self
 	for (int i = 0; i < posCount; ++i) {
@@ -45,9 +46,9 @@ static void testNoneAndSet(NameDict& dest, const std::string& name, const ObjRef
 }
 */
 
-static void testNoneAndSet(Frame::TFastLocalsList &dest, int index, const ObjRef &v) {
+static void testNoneAndSet(Frame::TFastLocalsList &dest, int index, ObjRef v) {
 	CHECK(index < dest.size() && dest[index].isNull(), "Argument already threre " << index);
-	dest[index] = v;
+	dest[index] = std::move(v);
 }
 
 void Frame::localsFromStack(Frame &from, ObjRef self, int posCount, int kwCount) {
@@ -68,13 +69,14 @@ void Frame::localsFromStack(Frame &from, ObjRef self, int posCount, int kwCount)
 	// go over the args in the stack, match to locals
 	for (int i = 0; i < kwCount; ++i) { // arguments passed by key-value
 		ObjRef      val   = from.pop();
-		std::string aname = checked_cast<StrObject>(from.pop())->v;
+		ObjRef      key   = from.pop();
+		const auto &aname = checked_cast<StrObject>(key)->v;
 		int         ci    = 0;
 		for (; ci < (int)c.co_argcount; ++ci) {
-			const std::string &cname = c.co_varnames[ci];
+			const Name &cname = c.co_varnames[ci]; // interned already, compared by its string without the atom table
 			if (cname == aname) {
 				//testNoneAndSet(dest, cname, val);
-				testNoneAndSet(dest, ci, val);
+				testNoneAndSet(dest, ci, std::move(val));
 				break;
 			}
 		}
@@ -85,9 +87,9 @@ void Frame::localsFromStack(Frame &from, ObjRef self, int posCount, int kwCount)
 		ObjRef a    = from.pop();
 		//testNoneAndSet(dest, c.co_varnames(posi), from.pop());
 		if (posi < (int)c.co_argcount)
-			testNoneAndSet(dest, posi, a);
+			testNoneAndSet(dest, posi, std::move(a));
 		else
-			starArgs->prepend(a); // arguments received by *args
+			starArgs->prepend(std::move(a)); // arguments received by *args
 	}
 	if (selfCount) {
 		//testNoneAndSet(dest, c.co_varnames(0), self);
@@ -104,7 +106,7 @@ NameDict &Frame::globals() {
 	return m_module->m_globals;
 }
 
-ObjRef Frame::lookupGlobal(const std::string &name) {
+ObjRef Frame::lookupGlobal(const Name &name) {
 	ObjRef ret = tryLookup(globals(), name);
 	if (!ret.isNull())
 		return ret;
@@ -133,6 +135,17 @@ void Frame::clear() {
 	m_module.reset();
 	m_stack.clear();      // vector clear
 	m_fastlocals.clear(); // container clear
+	m_callMethod.reset();
+	m_callAdapter.reset();
+}
+
+void Frame::traverse(const ObjVisitor &v) {
+	visitRef(v, m_code);
+	visitRef(v, m_module);
+	m_stack.foreach ([&](const ObjRef &o) { visitRef(v, o); });
+	m_fastlocals.foreach ([&](const ObjRef &o) { visitRef(v, o); });
+	visitRef(v, m_callMethod);
+	visitRef(v, m_callAdapter);
 }
 
 void Frame::setCode(const CodeObjRef &code) {
@@ -171,7 +184,7 @@ void ClassObject::makeMethods(const InstanceObjRef& i) {
     // then this class's method, possibly overrriding
     if (!m_methods.isNull()) {
         for(auto it = m_methods->v.begin(); it != m_methods->v.end(); ++it) {
-            if (it->second->type == METHOD)
+            if (it->second->type() == METHOD)
                 i->m_dict[it->first] = m_vm->alloc(new MethodObject( ((MethodObject*)it->second.get())->m_func ,i));
         }
     }
@@ -182,11 +195,12 @@ ObjRef ClassObject::call(Frame &from, Frame &frame, int posCount, int kwCount, c
 	InstanceObjRef i(frame.m_vm->alloct(new InstanceObject(ClassObjRef(this))));
 	// set up methods with self
 	//makeMethods(i);
-	ObjRef inito = i->simple_attr("__init__");
+	static const Name s_init("__init__");
+	ObjRef            inito = i->simple_attr(s_init);
 	if (!inito.isNull()) {
 		MethodObjRef init = checked_cast<MethodObject>(inito);
 		ObjRef       ret  = init->call(from, frame, posCount, kwCount, ObjRef());
-		CHECK(ret.isNull() || ret->type == Object::NONE, "__init__() must return None");
+		CHECK(ret.isNull() || ret->type() == Object::NONE, "__init__() must return None");
 	} // we can either call __init__() or the cpp ctor, not both since the arguments are removed from the stack
 	else if (!m_cwrap.isNull() && !m_cwrap->m_ctor.isNull()) {
 		CallArgs args;
@@ -200,9 +214,13 @@ ObjRef ClassObject::call(Frame &from, Frame &frame, int posCount, int kwCount, c
 //--------------------------------------- VM ------------------------------------------------------
 
 PyVM::PyVM()
-	: m_out(new LoggerPrinter(LOGLEVEL_DEBUG)), m_currentFrame(nullptr), m_lastFramei(-1), m_noneObject(alloc(new Object)), m_trueObject(alloc(new BoolObject(true))), m_falseObject(alloc(new BoolObject(false))) {
+	: m_collector(m_alloc), m_out(new LoggerPrinter(LOGLEVEL_DEBUG)), m_currentFrame(nullptr), m_lastFramei(-1), m_noneObject(alloc(new Object)), m_trueObject(alloc(new BoolObject(true))), m_falseObject(alloc(new BoolObject(false))) {
+	m_constants.setPool(&m_alloc);
 	m_defaultModule = alloct(new ModuleObject("__main__", this));
 	m_builtins      = alloct(new Builtins(this));
+	StringBuilder::addToModule(ModuleObjRef(m_builtins));
+	PatternMatcher::addToModule(ModuleObjRef(m_builtins));
+	GlobMatcher::addToModule(ModuleObjRef(m_builtins));
 }
 
 PyVM::~PyVM() {
@@ -210,6 +228,25 @@ PyVM::~PyVM() {
 	clear();
 }
 
+void PyVM::setMemoryLimits(int64_t soft, int64_t hard, TMemoryCallback onSoft) {
+	m_hardLimit   = hard > 0 ? hard : 0;
+	m_onSoftLimit = soft > 0 ? onSoft : TMemoryCallback();
+	int64_t limit = m_onSoftLimit ? soft : m_hardLimit;
+	if (m_onSoftLimit && m_hardLimit > 0)
+		limit = std::min(soft, m_hardLimit);
+	m_alloc.setByteLimit(limit, [this](int64_t used) { overMemoryLimit(used); });
+}
+
+void PyVM::overMemoryLimit(int64_t used) {
+	CHECK(m_hardLimit == 0 || used <= m_hardLimit, "MemoryError: " << used << " bytes is over the vm limit of " << m_hardLimit);
+	// the soft limit. the callback may set the limits again
+	TMemoryCallback onSoft = std::move(m_onSoftLimit);
+	m_onSoftLimit          = TMemoryCallback();
+	m_alloc.setByteLimit(m_hardLimit, [this](int64_t u) { overMemoryLimit(u); });
+	if (onSoft)
+		onSoft(used);
+}
+
 std::string PyVM::instructionPointer() {
 	std::ostringstream os;
 	os << "(" << m_lastFramei << ") ";
@@ -267,39 +304,53 @@ ModuleObjRef PyVM::importModule(const CodeDefinition& moduleDef, const std::stri
 }
 */
 
-ModuleObjRef PyVM::importPycStream(std::istream &is, const std::string &path, bool hasHeader) {
-	ObjRef      obj  = CodeDefinition::parsePyc(is, this, hasHeader);
-	auto        code = checked_cast<CodeObject>(obj);
-	std::string modName;
+// the module of the code parsed from a pyc
+static std::string moduleNameOf(const CodeObjRef &code, const std::string &path) {
 	if (!code->m_co.co_filename.empty())
-		modName = extractFileNameWithoutExtension(code->m_co.co_filename);
-	else if (!code->m_co.co_name.empty() && code->m_co.co_name != "<module>")
-		modName = code->m_co.co_name;
-	else {
-		CHECK(!path.empty(), "Missing module name");
-		modName = extractFileNameWithoutExtension(path);
-	}
-	auto module = addEmptyModule(modName);
+		return extractFileNameWithoutExtension(code->m_co.co_filename);
+	if (!code->m_co.co_name.empty() && code->m_co.co_name != "<module>")
+		return code->m_co.co_name;
+	CHECK(!path.empty(), "Missing module name");
+	return extractFileNameWithoutExtension(path);
+}
+
+ModuleObjRef PyVM::importPycStream(std::istream &is, const std::string &path, bool hasHeader) {
+	auto code   = checked_cast<CodeObject>(CodeDefinition::parsePyc(is, this, hasHeader));
+	auto module = addEmptyModule(moduleNameOf(code, path));
+	eval(code, module);
+	return module;
+}
+
+ModuleObjRef PyVM::importPycSpan(const ByteSpan &pyc, const std::string &path, bool hasHeader) {
+	auto code   = checked_cast<CodeObject>(CodeDefinition::parsePyc(pyc.data, pyc.size, this, hasHeader));
+	auto module = addEmptyModule(moduleNameOf(code, path));
 	eval(code, module);
 	return module;
 }
 
 ModuleObjRef PyVM::importPycFile(const std::string &pycpath) {
-	std::ifstream ifs(pycpath, std::ios::binary);
-	if (!ifs.good())
+	ByteSpan pyc = mapFile(pycpath);
+	if (pyc.data == nullptr)
 		return ModuleObjRef();
-	return importPycStream(ifs, pycpath, true);
+	return importPycSpan(pyc, pycpath, true);
 }
 
 ModuleObjRef PyVM::importPycBuf(const std::string &pyctext, bool hasHeader) {
-	std::istringstream iss(pyctext);
-	return importPycStream(iss, std::string(), hasHeader);
+	ByteSpan pyc;
+	pyc.data = pyctext.data();
+	pyc.size = pyctext.size();
+	return importPycSpan(pyc, std::string(), hasHeader);
 }
 
 ModuleObjRef PyVM::getModule(const std::string &name) {
 	ModuleObjRef mod = tryLookup(m_modules, name);
 	if (!mod.isNull())
 		return mod;
+	if (m_importSpanCallback) {
+		auto impret = m_importSpanCallback(name);
+		if (impret.first.data != nullptr)
+			return importPycSpan(impret.first, name, impret.second);
+	}
 	if (m_importCallback) {
 		auto impret = m_importCallback(name);
 		if (impret.first.get() != nullptr)
@@ -318,6 +369,26 @@ std::vector<std::string> split(const std::string &s, char delim) {
 	return elems;
 }
 
+Name PyVM::name(const std::string &s) {
+	auto it = m_names.find(s);
+	if (it != m_names.end())
+		return it->second;
+	Name n(s);
+	m_names.emplace(s, n);
+	return n;
+}
+
+Name PyVM::findName(const std::string &s) {
+	auto it = m_names.find(s);
+	if (it != m_names.end())
+		return it->second;
+	const Atom *a = Atom::find(s);
+	if (a == nullptr) // not cached, it may be interned later
+		return Name();
+	m_names.emplace(s, Name(a));
+	return Name(a);
+}
+
 // restrictions of names:
 // - code can't import one module to another
 // - can't call one class from another
@@ -330,13 +401,15 @@ ObjRef PyVM::lookupQual(const std::string &name, ModuleObjRef *mod) {
 		module   = getModule(names[0]);
 		funcname = names[1];
 	}
-	ObjRef func = module->attr(funcname);
+	Name fname = findName(funcname); // looking up doesn't intern
+	CHECK(!fname.isNull(), "Did not find function " << name);
+	ObjRef func = module->attr(fname);
 	if (!func.isNull()) {
 		if (mod)
 			*mod = module;
 		return func;
 	}
-	func = m_builtins->attr(funcname);
+	func = m_builtins->attr(fname);
 	if (!func.isNull()) {
 		if (mod)
 			*mod = static_pcast<ModuleObject>(m_builtins);
@@ -354,6 +427,9 @@ ObjRef PyVM::callv(const std::string &funcname, const std::vector<ObjRef> &posar
 
 // from cpp code
 ObjRef PyVM::callv(const ObjRef &ofunc, const std::vector<ObjRef> &posargs) {
+	// only from the outermost call, where no frame of the interpreter holds raw object pointers
+	if (m_currentFrame == nullptr)
+		m_collector.maybeStep();
 	ofunc->checkProp(Object::ICALLABLE);
 	CallableObjRef func = static_pcast<CallableObject>(ofunc);
 	Frame          dummyFrame(this, func->m_module, nullptr);
@@ -378,11 +454,43 @@ void PyVM::memDump(std::ostream &os) {
 void PyVM::clear() {
 	LOG_DEBUG("PyVM clear with ", m_alloc.size(), " objects");
 	m_modules.clear();
-	m_alloc.gradForeach([&](const ObjRef &o) {
+	m_alloc.foreachAll([&](const ObjRef &o) {
+		o->clear();
+	});
+	m_alloc.drain();
+}
+
+bool StateClearer::step(int maxObjects) {
+	close();
+	return !m_vm->objPool().stepBetween(m_epoch, *m_end, maxObjects, [](const ObjRef &o) {
 		o->clear();
 	});
 }
 
+bool StateClearer::step(std::chrono::steady_clock::time_point deadline) {
+	const int slice = 256; // objects cleared between looks at the clock
+	while (!step(slice)) {
+		if (std::chrono::steady_clock::now() >= deadline)
+			return false;
+	}
+	return true;
+}
+
+int PyVM::Region::release() {
+	if (m_released)
+		return m_escaped;
+	m_released = true;
+
+	// objects created in the scope
+	std::vector<Object *> objs;
+	m_vm->objPool().foreachSince(m_epoch, [&](const ObjRef &o) -> bool {
+		objs.push_back(o.get());
+		return true;
+	});
+	m_escaped = (int)objs.size() - freeUnreachable(objs);
+	return m_escaped;
+}
+
 void PyVM::addBuiltin(const ClassObjRef &v) {
 	addBuiltin(v->funcname(), ObjRef(v));
 }
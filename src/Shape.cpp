@@ -0,0 +1,27 @@
+// Copyright 2015 by Intigua, Inc.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "PyVM/Shape.h"
+
+Shape::Shape(const Shape *parent, const Name &name)
+	: m_parent(parent), m_names(parent->m_names) {
+	m_names.push_back(name);
+}
+
+Shape *Shape::withAdded(const Name &name) {
+	for (auto &t : m_transitions)
+		if (t.first == name)
+			return t.second.get();
+	if (size() >= MAX_SLOTS || m_transitions.size() >= MAX_TRANSITIONS)
+		return nullptr;
+	m_transitions.emplace_back(name, std::unique_ptr<Shape>(new Shape(this, name)));
+	return m_transitions.back().second.get();
+}
@@ -0,0 +1,268 @@
+// Copyright 2015 by Intigua, Inc.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "PyVM/StrKernels.h"
+
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define STRK_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+#if defined(STRK_SSE2) && defined(__GNUC__)
+#define STRK_AVX2 // compiled for avx2 with a target attribute, used only if the cpu has it
+#include <immintrin.h>
+#endif
+
+static const size_t npos = std::string::npos;
+
+static inline char foldAscii(char c) {
+	return (c >= 'A' && c <= 'Z') ? (char)(c + ('a' - 'A')) : c;
+}
+
+static inline bool isWhitespace(char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool iEqualsScalar(const char *a, const char *b, size_t n) {
+	for (size_t i = 0; i < n; ++i)
+		if (foldAscii(a[i]) != foldAscii(b[i]))
+			return false;
+	return true;
+}
+
+static size_t iFindScalar(const char *hay, size_t n, const char *needle, size_t m) {
+	if (m > n)
+		return npos;
+	for (size_t i = 0; i + m <= n; ++i)
+		if (iEqualsScalar(hay + i, needle, m))
+			return i;
+	return npos;
+}
+
+static size_t findWhitespaceScalar(const char *p, size_t n) {
+	for (size_t i = 0; i < n; ++i)
+		if (isWhitespace(p[i]))
+			return i;
+	return n;
+}
+
+static size_t findInt64Scalar(const int64_t *p, size_t n, int64_t x) {
+	for (size_t i = 0; i < n; ++i)
+		if (p[i] == x)
+			return i;
+	return n;
+}
+
+#ifdef STRK_SSE2
+
+static inline unsigned lowestBit(unsigned mask) {
+#ifdef _MSC_VER
+	unsigned long i;
+	_BitScanForward(&i, mask);
+	return i;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+static inline __m128i load16(const char *p) {
+	return _mm_loadu_si128((const __m128i *)p);
+}
+
+// 'A'..'Z' get 0x20 added, bytes >= 0x80 are negative so they never compare as upper case
+static inline __m128i fold16(__m128i v) {
+	__m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+	return _mm_add_epi8(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+static bool iEqualsSse2(const char *a, const char *b, size_t n) {
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(fold16(load16(a + i)), fold16(load16(b + i)))) != 0xffff)
+			return false;
+	}
+	return iEqualsScalar(a + i, b + i, n - i);
+}
+
+// candidates are the positions where the folded first character of the needle appears, checked 16 at a time
+static size_t iFindSse2(const char *hay, size_t n, const char *needle, size_t m) {
+	if (m == 0)
+		return 0;
+	if (m > n)
+		return npos;
+	size_t  starts = n - m + 1; // number of positions a match can start at
+	__m128i first  = _mm_set1_epi8(foldAscii(needle[0]));
+	size_t  i      = 0;
+	for (; i + 16 <= starts; i += 16) {
+		unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(fold16(load16(hay + i)), first));
+		for (; mask != 0; mask &= mask - 1) {
+			size_t at = i + lowestBit(mask);
+			if (iEqualsSse2(hay + at + 1, needle + 1, m - 1))
+				return at;
+		}
+	}
+	size_t r = iFindScalar(hay + i, n - i, needle, m);
+	return r == npos ? npos : i + r;
+}
+
+static size_t findWhitespaceSse2(const char *p, size_t n) {
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i v  = load16(p + i);
+		__m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+								  _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+		unsigned mask = _mm_movemask_epi8(ws);
+		if (mask != 0)
+			return i + lowestBit(mask);
+	}
+	return i + findWhitespaceScalar(p + i, n - i);
+}
+
+// sse2 compares 32 bits at a time, a 64 bit element is equal when both of its halves are
+static inline unsigned eq64Mask(const int64_t *p, __m128i key) {
+	__m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)p), key);
+	eq         = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_movemask_pd(_mm_castsi128_pd(eq));
+}
+
+static size_t findInt64Sse2(const int64_t *p, size_t n, int64_t x) {
+	__m128i key = _mm_set1_epi64x(x);
+	size_t  i   = 0;
+	for (; i + 4 <= n; i += 4) {
+		unsigned mask = eq64Mask(p + i, key) | (eq64Mask(p + i + 2, key) << 2);
+		if (mask != 0)
+			return i + lowestBit(mask);
+	}
+	return i + findInt64Scalar(p + i, n - i, x);
+}
+
+#endif // STRK_SSE2
+
+#ifdef STRK_AVX2
+
+#define AVX2_FUNC __attribute__((target("avx2")))
+
+AVX2_FUNC static inline __m256i load32(const char *p) {
+	return _mm256_loadu_si256((const __m256i *)p);
+}
+
+AVX2_FUNC static inline __m256i fold32(__m256i v) {
+	__m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+	return _mm256_add_epi8(v, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+
+AVX2_FUNC static bool iEqualsAvx2(const char *a, const char *b, size_t n) {
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		if ((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(fold32(load32(a + i)), fold32(load32(b + i)))) != 0xffffffffu)
+			return false;
+	}
+	return iEqualsSse2(a + i, b + i, n - i);
+}
+
+AVX2_FUNC static size_t iFindAvx2(const char *hay, size_t n, const char *needle, size_t m) {
+	if (m == 0)
+		return 0;
+	if (m > n)
+		return npos;
+	size_t  starts = n - m + 1;
+	__m256i first  = _mm256_set1_epi8(foldAscii(needle[0]));
+	size_t  i      = 0;
+	for (; i + 32 <= starts; i += 32) {
+		unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(fold32(load32(hay + i)), first));
+		for (; mask != 0; mask &= mask - 1) {
+			size_t at = i + lowestBit(mask);
+			if (iEqualsAvx2(hay + at + 1, needle + 1, m - 1))
+				return at;
+		}
+	}
+	size_t r = iFindSse2(hay + i, n - i, needle, m);
+	return r == npos ? npos : i + r;
+}
+
+AVX2_FUNC static size_t findWhitespaceAvx2(const char *p, size_t n) {
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		__m256i v  = load32(p + i);
+		__m256i ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+									 _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))));
+		unsigned mask = (unsigned)_mm256_movemask_epi8(ws);
+		if (mask != 0)
+			return i + lowestBit(mask);
+	}
+	return i + findWhitespaceSse2(p + i, n - i);
+}
+
+AVX2_FUNC static size_t findInt64Avx2(const int64_t *p, size_t n, int64_t x) {
+	__m256i key = _mm256_set1_epi64x(x);
+	size_t  i   = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i a    = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)(p + i)), key);
+		__m256i b    = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)(p + i + 4)), key);
+		unsigned mask = (unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(a)) | ((unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(b)) << 4);
+		if (mask != 0)
+			return i + lowestBit(mask);
+	}
+	return i + findInt64Sse2(p + i, n - i, x);
+}
+
+#endif // STRK_AVX2
+
+namespace {
+struct Kernels {
+	const char *name;
+	bool (*iEquals)(const char *, const char *, size_t);
+	size_t (*iFind)(const char *, size_t, const char *, size_t);
+	size_t (*findWhitespace)(const char *, size_t);
+	size_t (*findInt64)(const int64_t *, size_t, int64_t);
+};
+
+Kernels pickKernels() {
+#ifdef STRK_AVX2
+	if (__builtin_cpu_supports("avx2"))
+		return Kernels{ "avx2", iEqualsAvx2, iFindAvx2, findWhitespaceAvx2, findInt64Avx2 };
+#endif
+#ifdef STRK_SSE2
+	return Kernels{ "sse2", iEqualsSse2, iFindSse2, findWhitespaceSse2, findInt64Sse2 };
+#else
+	return Kernels{ "scalar", iEqualsScalar, iFindScalar, findWhitespaceScalar, findInt64Scalar };
+#endif
+}
+
+const Kernels &kernels() {
+	static const Kernels k = pickKernels();
+	return k;
+}
+} // namespace
+
+bool iEqualsAscii(const char *a, const char *b, size_t n) {
+	return kernels().iEquals(a, b, n);
+}
+
+size_t iFindAscii(const char *hay, size_t n, const char *needle, size_t m) {
+	return kernels().iFind(hay, n, needle, m);
+}
+
+size_t findWhitespace(const char *p, size_t n) {
+	return kernels().findWhitespace(p, n);
+}
+
+size_t findInt64(const int64_t *p, size_t n, int64_t x) {
+	return kernels().findInt64(p, n, x);
+}
+
+const char *strKernelsName() {
+	return kernels().name;
+}
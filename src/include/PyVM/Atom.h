@@ -0,0 +1,114 @@
+// Copyright 2015 by Intigua, Inc.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "defs.h"
+
+#include <string>
+#include <ostream>
+
+// an interned identifier. there is exactly one Atom for every distinct string so two atoms are equal
+// only if they are the same pointer. the hash is computed once when the string is interned.
+// the table is process-wide and atoms are never freed so only names should be interned, not arbitrary data
+class Atom {
+public:
+	// returns the atom of s, creating it if needed. thread safe
+	static const Atom *intern(const std::string &s);
+	// returns nullptr if s was never interned. never creates an atom. lookups from many threads don't wait for
+	// each other, but they do share a lock, so a vm caches what it looks up often, see PyVM::name()
+	static const Atom *find(const std::string &s);
+	static size_t count();
+	// about the memory the table takes. it is shared by all vms so it isn't counted in the memory of any of them
+	static size_t bytes();
+
+	const std::string &str() const {
+		return *m_str;
+	}
+	size_t hash() const {
+		return m_hash;
+	}
+
+	Atom(const std::string *s, size_t hash)
+		: m_str(s), m_hash(hash) {}
+
+private:
+	// points to the key in the intern table which never moves
+	const std::string *m_str;
+	size_t             m_hash;
+	DISALLOW_COPY_AND_ASSIGN(Atom)
+};
+
+// a handle to an Atom, this is what code objects, NameDict and attr() use for names.
+// constructing a Name from a string interns it, comparing two names is a pointer comparison.
+// a std::string is often data and not a name so it has to be made a Name explicitly. to look up a name that
+// came from data use Atom::find() or NameDict::find(), a string that was never interned isn't there anyway
+class Name {
+public:
+	Name()
+		: m_a(nullptr) {}
+	explicit Name(const std::string &s)
+		: m_a(Atom::intern(s)) {}
+	Name(const char *s)
+		: m_a(Atom::intern(s)) {}
+	explicit Name(const Atom *a)
+		: m_a(a) {}
+
+	const std::string &str() const {
+		return m_a->str();
+	}
+	operator const std::string &() const {
+		return m_a->str();
+	}
+	size_t hash() const {
+		return m_a->hash();
+	}
+	const Atom *atom() const {
+		return m_a;
+	}
+	bool isNull() const {
+		return m_a == nullptr;
+	}
+
+	bool operator==(const Name &o) const {
+		return m_a == o.m_a;
+	}
+	bool operator!=(const Name &o) const {
+		return m_a != o.m_a;
+	}
+	// comparing with a string does not intern it
+	bool operator==(const std::string &s) const {
+		return m_a != nullptr && m_a->str() == s;
+	}
+	bool operator!=(const std::string &s) const {
+		return !(*this == s);
+	}
+	bool operator==(const char *s) const {
+		return m_a != nullptr && m_a->str() == s;
+	}
+	bool operator!=(const char *s) const {
+		return !(*this == s);
+	}
+
+private:
+	const Atom *m_a;
+};
+
+inline bool operator==(const std::string &s, const Name &n) {
+	return n == s;
+}
+inline bool operator!=(const std::string &s, const Name &n) {
+	return n != s;
+}
+
+inline std::ostream &operator<<(std::ostream &os, const Name &n) {
+	return os << n.str();
+}
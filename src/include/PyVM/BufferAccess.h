@@ -98,3 +98,28 @@ private:
 	std::string m_buf;
 	int         m_offset = 0;
 };
+
+// accumulates a string, like cStringIO. a builtin in every vm.
+// the buffer is a str object, getvalue() returns it without a copy. appending after that copies the buffer
+// once if the returned string is still referenced, since strings are immutable once someone else can see them.
+// the str reference is not reported to the cycle collector, a str can't be part of a cycle anyway
+class StringBuilder {
+public:
+	static ClassObjRef addToModule(const ModuleObjRef &mod);
+
+	StringBuilder(PyVM *vm)
+		: m_vm(vm) {}
+
+	void   append(const ObjRef &s);
+	void   reserve(int sz);
+	int    size();
+	ObjRef getvalue();
+
+private:
+	// the buffer, made unique before it's changed
+	StrObject *buf();
+
+private:
+	PyVM     *m_vm;
+	StrObjRef m_str;
+};
@@ -12,6 +12,7 @@
 #pragma once
 
 #include "baseObject.h"
+#include "Atom.h"
 
 #include <vector>
 #include <string>
@@ -23,6 +24,9 @@ class PyVM;
 class CodeDefinition 
 {
 public:
+    // parses the data in place, it is not needed after this returns
+    static ObjRef parsePyc(const char* data, size_t size, PyVM* vm, bool hasHeader);
+    // reads all of iss first
     static ObjRef parsePyc(std::istream& iss, PyVM* vm, bool hasHeader);
 
     void parseCode(Deserialize& s, PyVM* vm);
@@ -30,12 +34,12 @@ public:
     std::string co_name;
     uint co_argcount;
     uint co_nlocals;
-    std::vector<std::string> co_varnames;
+    std::vector<Name> co_varnames;
     std::vector<std::string> co_cellvars;
     std::vector<std::string> co_freevars;
     std::string co_code;
     std::vector<ObjRef> co_consts;
-    std::vector<std::string> co_names;
+    std::vector<Name> co_names;
     std::string co_filename;
     uint co_firstlineno;
     std::string co_lnotab;
@@ -0,0 +1,79 @@
+// Copyright 2015 by Intigua, Inc.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "baseObject.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct ListObject;
+
+// the immortal constants of loaded code: ints, floats, str, unicode and tuples of constants.
+// nothing counts the references to an immortal object, so a constant can't be known to be unused while the vm
+// lives, it may have been stored anywhere. they are all kept until the vm is destroyed. to bound that, equal
+// constants are made once per vm: loading a module again adds nothing, the table only grows with constant values
+// it didn't have yet. a parse that fails takes back what it added with rollback().
+// the bytes of the constants are counted in the memory of the vm, see PyVM::setMemoryLimits()
+class ConstTable {
+public:
+	// bytes compared by their contents
+	struct Bytes {
+		const char *p;
+		size_t      n;
+		bool        operator<(const Bytes &o) const;
+	};
+
+	ConstTable() = default;
+	// the pool the bytes of the constants are counted in. it is given after construction since the table is
+	// made before the pool, to be destructed after it
+	void setPool(ObjPool<Object> *pool) {
+		m_pool = pool;
+	}
+	// newest first. a constant tuple is made after its items and still releases them when it is freed.
+	// the pool is gone by now, it doesn't need to hear of it
+	~ConstTable();
+
+	// the constant equal to v, made if there is none yet
+	ObjRef intConst(int64_t v);
+	ObjRef floatConst(double v);
+	ObjRef strConst(const Bytes &v);
+	ObjRef ustrConst(std::wstring &&v);
+	// t holds only constants. freed if there is an equal tuple already
+	ObjRef tupleConst(std::unique_ptr<ListObject> t);
+
+	// the point rollback() goes back to
+	size_t mark() const {
+		return m_objs.size();
+	}
+	// frees the constants made after mark. nothing may reference them anymore
+	void rollback(size_t mark);
+
+	size_t size() const {
+		return m_objs.size();
+	}
+
+private:
+	DISALLOW_COPY_AND_ASSIGN(ConstTable)
+	ObjRef add(Object *o);
+
+	ObjPool<Object>                        *m_pool = nullptr;
+	std::vector<std::unique_ptr<Object>>    m_objs; // in the order they were made
+	std::vector<size_t>                     m_charged; // the bytes of m_objs as they were made, the caches of a str may grow after
+	std::map<int64_t, Object *>             m_ints;
+	std::map<uint64_t, Object *>            m_floats; // by the binary value so 0.0 and -0.0 are different
+	std::map<Bytes, Object *>               m_strs;   // the keys point into the strings themselves
+	std::map<std::wstring, Object *>        m_ustrs;
+	std::map<std::vector<Object *>, Object *> m_tuples;
+};
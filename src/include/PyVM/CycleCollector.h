@@ -0,0 +1,67 @@
+// Copyright 2015 by Intigua, Inc.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "ObjPool.h"
+#include "baseObject.h"
+
+#include <vector>
+
+// trial deletion over a group of objects: the references the objects hold to each other are subtracted from their
+// reference counts. what's left are references from outside the group. objects that are not reachable from such
+// an object are only kept alive by cycles inside the group. these are cleared and freed.
+// returns the number of objects that were found to be garbage.
+int freeUnreachable(const std::vector<Object *> &objs);
+
+// optional collector for reference cycles that were created outside of a StateClearer or PyVM::Region scope.
+// step() examines a bounded window of the object pool, continuing from where the previous step stopped.
+// consecutive windows overlap by half so a cycle that is spread over less than half a window is found in one of them.
+// collect() examines the whole pool at once.
+// both must be called when no C++ code is in the middle of using a raw Object pointer, for example between calls into the vm.
+class CycleCollector {
+public:
+	CycleCollector(ObjPool<Object> &pool)
+		: m_pool(pool), m_cursor(pool) {}
+
+	// returns the number of objects freed
+	int collect();
+	int step(int maxObjects);
+
+	// make maybeStep() run step(stepObjects) whenever the pool grew by threshold objects since the last step.
+	// threshold 0 disables it (the default)
+	void setAutoStep(int threshold, int stepObjects) {
+		m_threshold   = threshold;
+		m_stepObjects = stepObjects;
+		m_lastSize    = m_pool.size();
+	}
+
+	// called by the vm when C++ code calls into it and no python code is running, see PyVM::callv().
+	// the caller must not be using a raw Object pointer then either
+	void maybeStep() {
+		if (m_threshold == 0)
+			return;
+		if (m_pool.size() < m_lastSize)
+			m_lastSize = m_pool.size();
+		else if (m_pool.size() - m_lastSize >= m_threshold) {
+			step(m_stepObjects);
+			m_lastSize = m_pool.size();
+		}
+	}
+
+private:
+	DISALLOW_COPY_AND_ASSIGN(CycleCollector)
+	ObjPool<Object> &       m_pool;
+	ObjPool<Object>::Epoch m_cursor; // start of the next window
+	int                     m_threshold   = 0;
+	int                     m_stepObjects = 0;
+	int                     m_lastSize    = 0;
+};
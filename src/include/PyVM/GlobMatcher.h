@@ -0,0 +1,65 @@
+// Copyright 2015 by Intigua, Inc.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "objects.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// a set of path glob rules matched together against a path. a builtin in every vm:
+//   rules = GlobMatcher(['/usr/**/lib*.so', '/etc/[a-c]?.conf'])
+//   rules.matches(path), rules.match(path), rules.matchall(path)
+// a component can hold '*', '?' and '[...]' ('[!...]' negates). a "**" component matches any number of components.
+// both rules and paths are compared in their path normalized form (see pathNormalized()), which for a path
+// is made once and cached in its string extension.
+// the rules are compiled into a trie of path components. literal components are found by binary search,
+// the wildcard ones are matched one by one, so a path is matched against all the rules in one pass over
+// its components. str and unicode rules and paths can be mixed
+class GlobMatcher {
+public:
+	static ClassObjRef addToModule(const ModuleObjRef &mod);
+
+	// rules is a list or a tuple of strings
+	GlobMatcher(PyVM *vm, const ObjRef &rules);
+
+	// does any rule match path
+	bool matches(const ObjRef &path);
+	// the index of the first rule that matches path, -1 if none does
+	int match(const ObjRef &path);
+	// the indices of all the rules that match path, in order
+	ObjRef matchall(const ObjRef &path);
+
+	int ruleCount() {
+		return m_ruleCount;
+	}
+
+private:
+	struct Node {
+		std::vector<std::pair<std::wstring, int>> literals; // sorted by component
+		std::vector<std::pair<std::wstring, int>> globs;    // components with wildcards
+		int                                       anyDepth = -1; // the child for a "**" component
+		bool                                      isAnyDepth = false;
+		std::vector<int>                          rules; // the rules that end at this node
+	};
+
+	// the nodes that are active after the whole path is consumed, each one once
+	void run(const ObjRef &path, std::vector<int> *active) const;
+	// the child node for comp, added if it's not there yet. children is not in m_nodes while this grows it
+	int child(std::vector<std::pair<std::wstring, int>> &children, const std::wstring &comp, bool sorted);
+
+private:
+	PyVM             *m_vm;
+	std::vector<Node> m_nodes; // 0 is the root
+	int               m_ruleCount = 0;
+};
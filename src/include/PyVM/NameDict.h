@@ -0,0 +1,242 @@
+// Copyright 2015 by Intigua, Inc.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "Atom.h"
+#include "baseObject.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// dictionary of names to objects, used for globals, locals, class and instance dicts.
+// entries are kept in a dense vector in insertion order. small dicts are searched linearly, bigger ones
+// get a sparse open addressing index of entry positions probed by the precomputed atom hash.
+// keys are compared by atom pointer, never by string.
+// erase leaves a dead entry (null name) which is dropped the next time the index is rebuilt
+class NameDict {
+public:
+	using value_type = std::pair<Name, ObjRef>;
+
+	NameDict() = default;
+	// the growth of the dict is accounted to owner, see Object::payloadChanged()
+	explicit NameDict(Object *owner)
+		: m_owner(owner) {}
+	// the copy belongs to owner, not to the owner of o
+	NameDict(const NameDict &o, Object *owner = nullptr)
+		: m_entries(o.m_entries), m_index(o.m_index), m_size(o.m_size), m_owner(owner) {}
+	NameDict(NameDict &&o, Object *owner = nullptr)
+		: m_entries(std::move(o.m_entries)), m_index(std::move(o.m_index)), m_size(o.m_size), m_owner(owner) {
+		o.m_entries.clear();
+		o.m_index.clear();
+		o.m_size = 0;
+	}
+	NameDict &operator=(const NameDict &) = delete;
+
+	template <typename D, typename V>
+	class Iter {
+	public:
+		Iter()
+			: m_d(nullptr), m_i(0) {}
+		Iter(D *d, size_t i)
+			: m_d(d), m_i(i) {
+			skipDead();
+		}
+		V &operator*() const {
+			return m_d->m_entries[m_i];
+		}
+		V *operator->() const {
+			return &m_d->m_entries[m_i];
+		}
+		Iter &operator++() {
+			++m_i;
+			skipDead();
+			return *this;
+		}
+		Iter operator++(int) {
+			Iter r(*this);
+			++(*this);
+			return r;
+		}
+		bool operator==(const Iter &o) const {
+			return m_i == o.m_i;
+		}
+		bool operator!=(const Iter &o) const {
+			return m_i != o.m_i;
+		}
+		size_t pos() const {
+			return m_i;
+		}
+
+	private:
+		void skipDead() {
+			while (m_i < m_d->m_entries.size() && m_d->m_entries[m_i].first.isNull())
+				++m_i;
+		}
+		D     *m_d;
+		size_t m_i;
+	};
+	using iterator = Iter<NameDict, value_type>;
+	using const_iterator = Iter<const NameDict, const value_type>;
+
+	iterator begin() {
+		return iterator(this, 0);
+	}
+	iterator end() {
+		return iterator(this, m_entries.size());
+	}
+	const_iterator begin() const {
+		return const_iterator(this, 0);
+	}
+	const_iterator end() const {
+		return const_iterator(this, m_entries.size());
+	}
+
+	size_t size() const {
+		return m_size;
+	}
+	bool empty() const {
+		return m_size == 0;
+	}
+	size_t payloadSize() const {
+		return m_entries.capacity() * sizeof(value_type) + m_index.capacity() * sizeof(int);
+	}
+	void clear() {
+		m_entries.clear();
+		m_index.clear();
+		m_size = 0;
+	}
+
+	iterator find(const Name &n) {
+		return iterator(this, indexOf(n.atom()));
+	}
+	const_iterator find(const Name &n) const {
+		return const_iterator(this, indexOf(n.atom()));
+	}
+	// a string that was never interned can't be in any NameDict, so this doesn't intern
+	iterator find(const std::string &s) {
+		return iterator(this, indexOf(Atom::find(s)));
+	}
+	const_iterator find(const std::string &s) const {
+		return const_iterator(this, indexOf(Atom::find(s)));
+	}
+	iterator find(const char *s) {
+		return find(std::string(s));
+	}
+	const_iterator find(const char *s) const {
+		return find(std::string(s));
+	}
+
+	ObjRef &operator[](const Name &n) {
+		size_t i = indexOf(n.atom());
+		if (i != m_entries.size())
+			return m_entries[i].second;
+		return insertNew(n);
+	}
+
+	std::pair<iterator, bool> insert(const value_type &v) {
+		size_t i = indexOf(v.first.atom());
+		if (i != m_entries.size())
+			return std::make_pair(iterator(this, i), false);
+		insertNew(v.first) = v.second;
+		return std::make_pair(iterator(this, m_entries.size() - 1), true);
+	}
+
+	size_t erase(const Name &n) {
+		size_t i = indexOf(n.atom());
+		if (i == m_entries.size())
+			return 0;
+		// the index slot keeps pointing to the dead entry so that probe chains through it stay intact
+		m_entries[i].first = Name();
+		m_entries[i].second.reset();
+		--m_size;
+		return 1;
+	}
+	size_t erase(const std::string &s) {
+		const Atom *a = Atom::find(s);
+		return (a == nullptr) ? 0 : erase(Name(a));
+	}
+	size_t erase(const char *s) {
+		return erase(std::string(s));
+	}
+
+private:
+	enum { LINEAR_MAX = 8 };
+
+	// returns m_entries.size() if not found
+	size_t indexOf(const Atom *a) const {
+		if (a == nullptr)
+			return m_entries.size();
+		if (m_index.empty()) {
+			for (size_t i = 0; i < m_entries.size(); ++i)
+				if (m_entries[i].first.atom() == a)
+					return i;
+			return m_entries.size();
+		}
+		size_t mask = m_index.size() - 1;
+		for (size_t s = a->hash() & mask;; s = (s + 1) & mask) {
+			int e = m_index[s];
+			if (e < 0)
+				return m_entries.size();
+			if (m_entries[e].first.atom() == a)
+				return e;
+		}
+	}
+
+	ObjRef &insertNew(const Name &n) {
+		size_t before = payloadSize();
+		if (!m_index.empty() ? (m_entries.size() + 1) * 3 > m_index.size() * 2 : m_entries.size() >= LINEAR_MAX)
+			rebuild();
+		if (m_entries.size() == m_entries.capacity())
+			m_entries.reserve(std::max<size_t>(LINEAR_MAX, m_entries.capacity() * 2));
+		if (m_owner != nullptr) // the new entry is not there yet if this throws
+			ObjPool<Object>::resized(m_owner, (int64_t)payloadSize() - (int64_t)before);
+		m_entries.emplace_back(n, ObjRef());
+		++m_size;
+		if (!m_index.empty())
+			indexEntry(m_entries.size() - 1);
+		return m_entries.back().second;
+	}
+
+	// drop dead entries and size the index for the live ones with room to grow
+	void rebuild() {
+		if (m_size != m_entries.size()) {
+			size_t w = 0;
+			for (size_t r = 0; r < m_entries.size(); ++r)
+				if (!m_entries[r].first.isNull())
+					m_entries[w++] = std::move(m_entries[r]);
+			m_entries.resize(w);
+		}
+		m_index.clear();
+		if (m_size < LINEAR_MAX)
+			return;
+		size_t cap = 16;
+		while (cap * 2 < (m_size + 1) * 3 * 2)
+			cap *= 2;
+		m_index.assign(cap, -1);
+		for (size_t i = 0; i < m_entries.size(); ++i)
+			indexEntry(i);
+	}
+
+	void indexEntry(size_t i) {
+		size_t mask = m_index.size() - 1;
+		size_t s = m_entries[i].first.hash() & mask;
+		while (m_index[s] >= 0)
+			s = (s + 1) & mask;
+		m_index[s] = (int)i;
+	}
+
+	std::vector<value_type> m_entries;
+	std::vector<int>        m_index;
+	size_t                  m_size  = 0;
+	Object                 *m_owner = nullptr;
+};
@@ -0,0 +1,155 @@
+// Copyright 2015 by Intigua, Inc.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "baseObject.h"
+
+#include <vector>
+
+// defined in instruction.cpp
+int64_t hashNum(const ObjRef &argref);
+// equality of two dict keys with fast paths for keys of the same type, falls back to OpImp::compare()
+bool dictKeyEquals(const ObjRef &a, const ObjRef &b, PyVM *vm);
+
+// the storage of DictObject, a hash table of any hashable objects, iterated in insertion order.
+// same layout as CPython 3.6 dicts: entries are kept dense in insertion order and a sparse open addressing
+// index, probed with CPython's perturbation scheme, points into them.
+// every entry keeps its key hash so probing compares keys only on a hash match and growing never rehashes keys.
+// erase leaves a dead entry (null key) which is dropped the next time the index is rebuilt.
+// while all the keys are ints, or all are strs, a lookup of a key of that kind compares the keys directly
+// without the generic compare. an int is its own hash so an int key is mostly found by its hash alone
+class ObjDict {
+public:
+	// the kind of keys the dict has had since it was last empty
+	enum KeyKind {
+		NO_KEYS,
+		INT_KEYS,
+		STR_KEYS,
+		ANY_KEYS
+	};
+
+	struct Entry {
+		ObjRef  first; // key
+		ObjRef  second; // value
+		int64_t hash;
+	};
+
+	template <typename D, typename V>
+	class Iter {
+	public:
+		Iter()
+			: m_d(nullptr), m_i(0) {}
+		Iter(D *d, size_t i)
+			: m_d(d), m_i(i) {
+			skipDead();
+		}
+		V &operator*() const {
+			return m_d->m_entries[m_i];
+		}
+		V *operator->() const {
+			return &m_d->m_entries[m_i];
+		}
+		Iter &operator++() {
+			++m_i;
+			skipDead();
+			return *this;
+		}
+		Iter operator++(int) {
+			Iter r(*this);
+			++(*this);
+			return r;
+		}
+		bool operator==(const Iter &o) const {
+			return m_i == o.m_i;
+		}
+		bool operator!=(const Iter &o) const {
+			return m_i != o.m_i;
+		}
+
+	private:
+		void skipDead() {
+			while (m_i < m_d->m_entries.size() && m_d->m_entries[m_i].first.isNull())
+				++m_i;
+		}
+		D     *m_d;
+		size_t m_i;
+	};
+	using iterator = Iter<ObjDict, Entry>;
+	using const_iterator = Iter<const ObjDict, const Entry>;
+
+	// vm is needed for the compare which needs it in order to create unicode objects if the need of conversion arises.
+	// the growth of the dict is accounted to owner, see Object::payloadChanged()
+	explicit ObjDict(PyVM *vm, Object *owner = nullptr)
+		: m_vm(vm), m_owner(owner) {}
+
+	iterator begin() {
+		return iterator(this, 0);
+	}
+	iterator end() {
+		return iterator(this, m_entries.size());
+	}
+	const_iterator begin() const {
+		return const_iterator(this, 0);
+	}
+	const_iterator end() const {
+		return const_iterator(this, m_entries.size());
+	}
+
+	size_t size() const {
+		return m_size;
+	}
+	bool empty() const {
+		return m_size == 0;
+	}
+	void clear() {
+		m_entries.clear();
+		m_index.clear();
+		m_size    = 0;
+		m_keyKind = NO_KEYS;
+	}
+	KeyKind keyKind() const {
+		return m_keyKind;
+	}
+	size_t payloadSize() const {
+		return m_entries.capacity() * sizeof(Entry) + m_index.capacity() * sizeof(int);
+	}
+	void reserve(size_t n);
+
+	iterator find(const ObjRef &key) {
+		return iterator(this, indexOf(key, keyHash(key)));
+	}
+	const_iterator find(const ObjRef &key) const {
+		return const_iterator(this, indexOf(key, keyHash(key)));
+	}
+	ObjRef &operator[](const ObjRef &key);
+	size_t  erase(const ObjRef &key);
+
+private:
+	enum { MIN_INDEX = 8 };
+
+	static int64_t keyHash(const ObjRef &key);
+	// returns m_entries.size() if not found
+	size_t indexOf(const ObjRef &key, int64_t hash) const;
+	// the live entry with the given hash for which eq(entry) is true
+	template <typename Eq>
+	size_t probe(int64_t hash, Eq eq) const;
+	void   rebuild(size_t forSize);
+	void   indexEntry(size_t i);
+	void   grown(size_t before);
+
+	std::vector<Entry> m_entries;
+	std::vector<int>   m_index; // -1 for an empty slot
+	size_t             m_size    = 0;
+	KeyKind            m_keyKind = NO_KEYS;
+	PyVM              *m_vm;
+	Object            *m_owner;
+};
@@ -15,6 +15,14 @@
 #include "defs.h"
 #include "log.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 
 template<typename T>
 class ObjPool;
@@ -26,9 +34,7 @@ public:
 	PoolPtr() = default;
 
     PoolPtr(const PoolPtr& o) : m_p(o.m_p) {
-        if (m_p != nullptr) {
-            ++m_p->count.count;
-        }
+        addRef();
     }
 
 	PoolPtr(PoolPtr&& o) {
@@ -37,8 +43,7 @@ public:
     }
 
 	explicit PoolPtr(T* p) :m_p(p) {
-        if (m_p != nullptr)
-            ++m_p->count.count;
+        addRef();
     }
 
 	template<typename U>
@@ -47,7 +52,7 @@ public:
             return;
         m_p = dynamic_cast<U*>(o.get());
         CHECK(m_p != nullptr, "Incompatible conversion");
-        ++m_p->count.count;
+        addRef();
     }
 
     ~PoolPtr() {
@@ -59,17 +64,26 @@ public:
             return *this;
         reset();
         m_p = o.m_p;
-        if (m_p != nullptr) {
-            ++m_p->count.count;
-        }
+        addRef();
+        return *this;
+    }
+
+    // takes the reference of o without touching the count
+    PoolPtr& operator=(PoolPtr&& o) {
+        if (&o == this)
+            return *this;
+        T* p = o.m_p; // o may be released by reset()
+        o.m_p = nullptr;
+        reset();
+        m_p = p;
         return *this;
     }
 
     void reset() {
         if (m_p == nullptr)
             return;
-        if (--m_p->count.count == 0) {
-            m_p->count.pool->remove(m_p);
+        if (!m_p->count.immortal() && --m_p->count.count == 0) {
+            decltype(m_p->count)::Pool::remove(m_p); // the pool of the base type that has the RefCount
         }
         m_p = nullptr;
     }
@@ -101,6 +115,11 @@ public:
     }
 
 private:
+    void addRef() {
+        if (m_p != nullptr && !m_p->count.immortal())
+            ++m_p->count.count;
+    }
+
 	T* m_p = nullptr;
 
     friend class ObjPool<T>;
@@ -117,93 +136,29 @@ PoolPtr<U> dynamic_pcast(const PoolPtr<T>& o) {
 }
 
 
-// doubly linked list that hold objects of type T. T objects should have public data member count of type RefCount<T>
-template<typename T>
-class DList {
-private:
-	T *m_head = nullptr;
-	T *m_tail = nullptr;
-	int m_size = 0;
-
-public:
-    struct Entry {
-		T *next = nullptr;
-		T *prev = nullptr;
-    };
-
-    struct iterator {
-        iterator(T* p) : ptr(p) {}
-        T* get() { return ptr; }
-        bool operator!=(iterator rhs) { return ptr != rhs.ptr; }
-        bool operator==(iterator rhs) { return ptr == rhs.ptr; }
-        iterator& operator++() {// prefix
-            CHECK(ptr != nullptr, "unexpected nullptrptr");
-            ptr = ptr->count.ent.next;
-            return *this;
-        }
-        T* ptr;
-    };
-
-	DList() {
-        // two dummy nodes that are always there.
-        m_head = new T();
-        m_tail = new T();
-        m_head->count.ent.next = m_tail;
-        m_tail->count.ent.prev = m_head;
-    }
-
-	~DList() {
-        if (m_size != 0) {
-            LOG_ERROR("Object pool not empty. size=", m_size, " global objects?");
-        }
-        delete m_head;
-        delete m_tail;
-    }
-
-    // push at head
-    void push_front(T* v) { 
-        Entry* n = &v->count.ent;// new Entry(m_head, v, m_head->next);
-        n->prev = m_head;
-        n->next = m_head->count.ent.next;
-        m_head->count.ent.next->count.ent.prev = v;
-        m_head->count.ent.next = v;
-        ++m_size;
-    }
-
-    iterator begin() {
-        return iterator(m_head->count.ent.next);
-    }
-
-	iterator end() {
-        return iterator(m_tail); // one after last
-    }
-
-	void erase(T* v) {
-        if (v == nullptr)
-            return;
-        CHECK(v != m_head && v != m_tail, "Unexpected state DList");
-        Entry* e = &v->count.ent;
-        e->next->count.ent.prev = e->prev;
-        e->prev->count.ent.next = e->next;
-        --m_size;
-    }
-
-	int size() const {
-        return m_size;
-    }
-};
-
+// kept at 8 bytes since every object has one
 template<typename T>
 struct RefCount {
-	RefCount() = default;
+	using Pool = ObjPool<T>;
+	// count of an object that is not in a pool and is never freed by its references. PoolPtr doesn't touch it
+	enum { IMMORTAL = -1 };
+	// slot of an object that was never added to a pool. it may be referenced before that, from its own constructor
+	enum { NO_SLOT = (1 << 26) - 1 };
+
+	RefCount() : slot(NO_SLOT), user(0) {}
 	~RefCount() = default;
 
+	bool immortal() const {
+		return count < 0;
+	}
+
 	int count = 0;
-	ObjPool<T> *pool = nullptr;
-    typename DList<T>::Entry ent;
+	uint slot : 26; // handle of the registry slot of the object. also tells which pool it belongs to, see ObjPool::remove()
+	uint user : 6;  // not used by the pool, free for T to use
 private:
 	DISALLOW_COPY_AND_ASSIGN(RefCount)
 };
+static_assert(sizeof(RefCount<int>) == 8, "RefCount should be 8 bytes");
 
 
 //#define OBJ_CNT_PRINT_DELTA_MS  10*60*1000 //10 mins
@@ -211,65 +166,198 @@ private:
 /** A pool of reference counter objects of type T
  * T should have a public data member named 'count' of type RefCount<T>
  * The pool can hold objects that inherit from T
- * it holds a doubly linked list of T objects. the next and prev pointes are inside RefCount::ent
+ * Objects are registered in chunks of pointers, in allocation order. removing an object leaves an empty slot which
+ * is reclaimed by compacting the registry when it needs to grow.
+ * every chunk has a process wide id which is looked up in a table to find its pool. RefCount::slot is the chunk id
+ * and the index in the chunk so objects don't need a pointer to their pool.
+ * freed objects are deleted from a queue rather than from inside the destructor of the object that released them,
+ * so freeing a long chain of objects doesn't recurse. the queue is emptied before the outermost release returns,
+ * unless a destroy budget is set, then every release deletes up to that many objects and drain() finishes the rest.
+ * the pool also counts the bytes of its objects. every slot keeps the bytes accounted to its object so removing
+ * it takes off exactly what was added for it, whatever the object did in between.
  */
 template<typename T>
 class ObjPool 
 {
 public:
+	// a point in the allocation order of the pool. objects added after it was taken are walked by foreachSince()
+	class Epoch {
+	public:
+		explicit Epoch(ObjPool &pool) : m_pool(&pool), m_index(pool.m_end) {
+			pool.m_epochs.push_back(this);
+		}
+		~Epoch() {
+			auto &e = m_pool->m_epochs;
+			e.erase(std::find(e.begin(), e.end(), this));
+		}
+	private:
+		DISALLOW_COPY_AND_ASSIGN(Epoch)
+		ObjPool *m_pool;
+		int m_index; // updated when the registry is compacted
+		friend class ObjPool;
+	};
+
 	ObjPool() = default;
 
-    // takes ownership of p
-    PoolPtr<T> add(T* p) {  
+	~ObjPool() {
+        drain();
+        if (m_size != 0) {
+            LOG_ERROR("Object pool not empty. size=", m_size, " global objects?");
+        }
+        releaseChunks(0);
+    }
+
+    // takes ownership of p. bytes is what p takes in memory, see bytes().
+    // if that goes over the byte limit, the callback of setByteLimit() is called after p is in the pool. if it
+    // throws, p is freed
+    PoolPtr<T> add(T* p, int64_t bytes = 0) {
         PoolPtr<T> ret(p);
-        m_objs.push_front(p);
-        p->count.pool = this; 
+        if (m_end == (int)m_chunks.size() * CHUNK_SIZE) {
+            // reclaim empty slots before growing if at least half of them are empty. this keeps add() amortized O(1)
+            if (m_iterating == 0 && (m_end - m_size) * 2 > m_end)
+                compact();
+            if (m_end == (int)m_chunks.size() * CHUNK_SIZE)
+                addChunk();
+        }
+        slot(m_end) = p;
+        slotBytes(m_end) = bytes;
+        p->count.slot = handle(m_end++);
+        ++m_size;
+        m_bytes += bytes;
+        if (m_bytes > m_byteLimit)
+            m_overLimit(m_bytes);
         return ret;
     }
 
-    void remove(T* v) {
+    // called when the last reference to v is released
+    static void remove(T* v) {
         //printObjCntIfNeeded(); disabled since it garbages the log. instead, print the count before destruction of the pool in PyVM::clear()
-        m_objs.erase(v);
-        delete v;
-        m_hadRemove = true;
+        const ChunkOwner& owner = chunkTable().owners[v->count.slot >> CHUNK_SHIFT];
+        owner.slots[v->count.slot & (CHUNK_SIZE - 1)] = nullptr;
+        ObjPool* pool = owner.pool;
+        --pool->m_size;
+        pool->m_bytes -= owner.bytes[v->count.slot & (CHUNK_SIZE - 1)];
+        pool->m_pending.push_back(v);
+        if (!pool->m_draining) // otherwise v is deleted by the drain() up the stack
+            pool->drain(pool->m_destroyBudget);
     }
 
+    // v grew or shrank by delta bytes. does nothing for an object that is not in a pool, an object that is
+    // added later is accounted by add() as it is then. growing over the byte limit calls the callback of
+    // setByteLimit() after the bytes are accounted, so call it when v is consistent
+    static void resized(const T* v, int64_t delta) {
+        if (delta == 0 || v->count.count <= 0 || v->count.slot == RefCount<T>::NO_SLOT) // immortal, not added yet or being deleted
+            return;
+        const ChunkOwner& owner = chunkTable().owners[v->count.slot >> CHUNK_SHIFT];
+        owner.bytes[v->count.slot & (CHUNK_SIZE - 1)] += delta;
+        ObjPool* pool = owner.pool;
+        pool->m_bytes += delta;
+        if (delta > 0 && pool->m_bytes > pool->m_byteLimit)
+            pool->m_overLimit(pool->m_bytes);
+    }
+
+    // accounts bytes that are not in an object of the pool but should count against the limit, such as the
+    // constants of a vm. calls the callback of setByteLimit() like resized()
+    void addBytes(int64_t delta) {
+        m_bytes += delta;
+        if (delta > 0 && m_bytes > m_byteLimit)
+            m_overLimit(m_bytes);
+    }
+
+    // the bytes of all the objects in the pool, as given to add(), resized() and addBytes()
+    int64_t bytes() const {
+        return m_bytes;
+    }
+
+    // overLimit is called with bytes() when an add() or a resized() takes it over limit. it may throw, or set
+    // another limit. 0 is no limit
+    void setByteLimit(int64_t limit, std::function<void(int64_t)> overLimit) {
+        m_byteLimit = limit > 0 ? limit : std::numeric_limits<int64_t>::max();
+        m_overLimit = std::move(overLimit);
+    }
+
+    // delete freed objects that are waiting in the queue, at most budget of them, 0 for all.
+    // returns the number of objects left in the queue
+    int drain(int budget = 0) {
+        if (m_draining)
+            return (int)m_pending.size();
+        m_draining = true;
+        for (int n = 0; !m_pending.empty() && (budget == 0 || n < budget); ++n) {
+            T* v = m_pending.back();
+            m_pending.pop_back();
+            delete v; // the objects this frees are queued
+        }
+        m_draining = false;
+        return (int)m_pending.size();
+    }
+
+    // the most objects a single release deletes, 0 for no limit. with a limit, call drain() to bound when the rest is deleted
+    void setDestroyBudget(int budget) {
+        m_destroyBudget = budget;
+    }
+
+    // objects that were freed and are not deleted yet
+    int pendingCount() const {
+        return (int)m_pending.size();
+    }
+
+    // walk all objects in allocation order. stops and returns false if f returns false
     template<typename F>
     bool foreach(const F& f) {
-        PoolPtr<T> p(m_objs.begin().ptr);
-        typename DList<T>::iterator it(p.get());
-        while( it != m_objs.end()) {
-            // need to get the reference to the next one before it is possibly destroyed (delay its destruction)
-            ++it;
-            PoolPtr<T> nextp( (it != m_objs.end()) ? (it.ptr) : nullptr ); 
-            if (!f(p))
-                return false;
-            p = nextp;
+        return foreachFrom(0, f);
+    }
+
+    // walk all objects added after e was taken, in allocation order
+    template<typename F>
+    bool foreachSince(const Epoch& e, const F& f) {
+        return foreachFrom(e.m_index, f);
+    }
+
+    // walk at most max objects from e, not going past end, and move e after them.
+    // returns false when e got to end. objects added during the walk are after end so they are not visited
+    template<typename F>
+    bool stepBetween(Epoch& e, const Epoch& end, int max, const F& f) {
+        IterGuard guard(m_iterating);
+        for (; e.m_index < end.m_index && max > 0; ++e.m_index) {
+            T* o = slot(e.m_index);
+            if (o == nullptr)
+                continue;
+            PoolPtr<T> p(o);
+            f(p);
+            --max;
         }
-        return true;
+        return e.m_index < end.m_index;
+    }
+
+    // move e back to the start of the pool
+    void rewind(Epoch& e) {
+        e.m_index = 0;
+    }
+
+    // move e forward past count objects. returns false if it got to the end of the pool
+    bool advance(Epoch& e, int count) {
+        for (; count > 0 && e.m_index < m_end; ++e.m_index) {
+            if (slot(e.m_index) != nullptr)
+                --count;
+        }
+        return e.m_index < m_end;
     }
 
     int size() const { 
-        return m_objs.size();
+        return m_size;
     }
-    T* listHead() {
-        return m_objs.begin().get();
-    }   
 
-    // the problem this avoids is that if the object we're on is just freed 
-    // since it was part of a circle, we can't get to the next one
+    // walk every object once, also the ones f adds. f may free any object, even the next ones since a cycle
+    // is freed all at once. they just leave empty slots behind, so this is a single linear pass
     template<typename F>
-    void gradForeach(const F& f) {
-        while (true) {
-            m_hadRemove = false;
-            auto it = m_objs.begin();
-            for(; it != m_objs.end(); ++it) {
-                f(PoolPtr<T>(it.get()));
-                if (m_hadRemove) // maybe someone removed the iterator.
-                    break;
-            }
-            if (it == m_objs.end())
-                break;
+    void foreachAll(const F& f) {
+        for (int start = 0; start < m_end;) {
+            int end = m_end; // foreachFrom() walks up to here, added objects are done in the next round
+            foreachFrom(start, [&](const PoolPtr<T>& p)->bool {
+                f(p);
+                return true;
+            });
+            start = end;
         }
     }
 
@@ -283,7 +371,127 @@ public:
     }
 
 private:
-    DList<T> m_objs;
-	bool m_hadRemove = false; // used in gradForeach
-};
+    enum { 
+        CHUNK_SHIFT = 12, CHUNK_SIZE = 1 << CHUNK_SHIFT, 
+        MAX_CHUNKS = (1 << (26 - CHUNK_SHIFT)) - 1 // all pools of T together, limited by the size of RefCount::slot. the last handle is RefCount::NO_SLOT
+    };
 
+    struct ChunkOwner {
+        ObjPool* pool;
+        T** slots;
+        int64_t* bytes; // per slot
+    };
+    // shared by all pools of T. an entry is only written when the chunk is taken by a pool and then only read by that pool
+    struct ChunkTable {
+        std::mutex lock; // for taking and returning chunk ids
+        std::vector<int> freeIds;
+        int next = 0;
+        ChunkOwner owners[MAX_CHUNKS];
+    };
+    static ChunkTable& chunkTable() {
+        static ChunkTable t;
+        return t;
+    }
+
+    void addChunk() {
+        ChunkTable& t = chunkTable();
+        int id;
+        {
+            std::lock_guard<std::mutex> l(t.lock);
+            if (!t.freeIds.empty()) {
+                id = t.freeIds.back();
+                t.freeIds.pop_back();
+            }
+            else {
+                CHECK(t.next < MAX_CHUNKS, "Too many objects");
+                id = t.next++;
+            }
+        }
+        m_chunks.emplace_back(new T*[CHUNK_SIZE]);
+        m_byteChunks.emplace_back(new int64_t[CHUNK_SIZE]);
+        m_chunkIds.push_back(id);
+        t.owners[id] = ChunkOwner{ this, m_chunks.back().get(), m_byteChunks.back().get() };
+    }
+
+    // free all chunks from index 'from'
+    void releaseChunks(size_t from) {
+        ChunkTable& t = chunkTable();
+        std::lock_guard<std::mutex> l(t.lock);
+        for (size_t i = from; i < m_chunkIds.size(); ++i)
+            t.freeIds.push_back(m_chunkIds[i]);
+        m_chunkIds.resize(std::min(from, m_chunkIds.size()));
+        m_chunks.resize(m_chunkIds.size());
+        m_byteChunks.resize(m_chunkIds.size());
+    }
+
+    T*& slot(int i) {
+        return m_chunks[i >> CHUNK_SHIFT][i & (CHUNK_SIZE - 1)];
+    }
+
+    int64_t& slotBytes(int i) {
+        return m_byteChunks[i >> CHUNK_SHIFT][i & (CHUNK_SIZE - 1)];
+    }
+
+    uint handle(int i) const {
+        return ((uint)m_chunkIds[i >> CHUNK_SHIFT] << CHUNK_SHIFT) | (i & (CHUNK_SIZE - 1));
+    }
+
+    struct IterGuard {
+        IterGuard(int& c) : m_c(c) { ++m_c; }
+        ~IterGuard() { --m_c; }
+        int& m_c;
+    };
+
+    template<typename F>
+    bool foreachFrom(int start, const F& f) {
+        // objects added during the walk are not visited. removed objects leave an empty slot so the walk is not disturbed
+        IterGuard guard(m_iterating);
+        const int end = m_end;
+        for (int i = start; i < end; ++i) {
+            T* o = slot(i);
+            if (o == nullptr)
+                continue;
+            PoolPtr<T> p(o); // delay its destruction until f is done with it
+            if (!f(p))
+                return false;
+        }
+        return true;
+    }
+
+    // move all objects to the start of the registry, keeping their order
+    void compact() {
+        std::vector<Epoch*> epochs(m_epochs);
+        std::sort(epochs.begin(), epochs.end(), [](const Epoch* a, const Epoch* b) { return a->m_index < b->m_index; });
+        auto eit = epochs.begin();
+        int w = 0;
+        for (int i = 0; i < m_end; ++i) {
+            for (; eit != epochs.end() && (*eit)->m_index <= i; ++eit)
+                (*eit)->m_index = w;
+            T* o = slot(i);
+            if (o == nullptr)
+                continue;
+            slot(w) = o;
+            slotBytes(w) = slotBytes(i);
+            o->count.slot = handle(w++);
+        }
+        for (; eit != epochs.end(); ++eit)
+            (*eit)->m_index = w;
+        m_end = w;
+        releaseChunks((m_end >> CHUNK_SHIFT) + 1);
+    }
+
+private:
+    std::vector<std::unique_ptr<T*[]>> m_chunks;
+    std::vector<std::unique_ptr<int64_t[]>> m_byteChunks; // the bytes of every slot, in chunks like m_chunks
+    std::vector<int> m_chunkIds; // id in chunkTable() of every chunk in m_chunks
+    int m_end = 0;  // one after the last used slot
+    int m_size = 0; // number of objects, not counting empty slots
+    int m_iterating = 0; // no compaction while walking the objects
+    std::vector<Epoch*> m_epochs;
+    std::vector<T*> m_pending; // freed objects waiting to be deleted
+    bool m_draining = false;
+    int m_destroyBudget = 0;
+    int64_t m_bytes = 0;
+    int64_t m_byteLimit = std::numeric_limits<int64_t>::max();
+    std::function<void(int64_t)> m_overLimit;
+};
\ No newline at end of file
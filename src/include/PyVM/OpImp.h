@@ -23,6 +23,11 @@ public:
 	template <typename OT>
 	ObjRef addType(Object *lhs, Object *rhs);
 	ObjRef add(const ObjRef &lhsref, const ObjRef &rhsref);
+	// lhs += rhs without a new object: list extend, or string append when lhs is referenced only by the caller.
+	// returns false if it can't be done in place
+	bool addInPlace(const ObjRef &lhsref, const ObjRef &rhsref);
+	template <typename OT>
+	ObjRef concatList(Object *lhs, Object *rhs);
 
 	template <typename OT>
 	ObjRef multType(Object *lhs, Object *rhs);
@@ -0,0 +1,71 @@
+// Copyright 2015 by Intigua, Inc.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "objects.h"
+
+#include <unordered_map>
+#include <vector>
+
+// a set of substrings that are all looked for in a single pass over a string. a builtin in every vm:
+//   m = compile_patterns(['foo', 'bar'], casei=True)
+//   m.matches(s), m.search(s), m.findall(s)
+// built once into an Aho-Corasick automaton with all the failure transitions resolved, so scanning is one
+// table lookup per character. patterns and inputs can be str or unicode, a str character compares to a unicode
+// one as if the str was converted to unicode. casei folds ascii only, like iContains().
+// a matcher never changes after it is built so it can be kept in a module global and used from anywhere.
+// the pattern references are not reported to the cycle collector, a str can't be part of a cycle anyway
+class PatternMatcher {
+public:
+	static ClassObjRef addToModule(const ModuleObjRef &mod);
+
+	// patterns is a list or a tuple of non empty strings
+	PatternMatcher(PyVM *vm, const ObjRef &patterns)
+		: PatternMatcher(vm, patterns, false) {}
+	PatternMatcher(PyVM *vm, const ObjRef &patterns, bool casei);
+
+	// does any of the patterns appear in s
+	bool matches(const ObjRef &s);
+	// the pattern of the match that ends first in s, None if there is none
+	ObjRef search(const ObjRef &s);
+	// a (start, pattern) tuple for every match in s, overlapping ones included, in the order they end
+	ObjRef findall(const ObjRef &s);
+
+	int patternCount() {
+		return (int)m_patterns.size();
+	}
+
+private:
+	// calls f(end, state) after every character that completes a match, end is the position after it.
+	// stops when f returns false
+	template <typename F>
+	void scan(const ObjRef &s, F f) const;
+	int classOf(uint32_t u) const;
+	int addClass(uint32_t u);
+	uint32_t fold(uint32_t u) const {
+		return (m_casei && u >= 'A' && u <= 'Z') ? u + ('a' - 'A') : u;
+	}
+
+private:
+	PyVM               *m_vm;
+	bool                m_casei;
+	std::vector<ObjRef> m_patterns;
+
+	// code units are mapped to character classes, 0 for those that appear in no pattern
+	int                               m_classCount = 1;
+	int                               m_lowClass[256];  // unicode code units below 256
+	int                               m_byteClass[256]; // str bytes
+	std::unordered_map<uint32_t, int> m_highClass;
+
+	std::vector<int>              m_delta; // state * m_classCount + class -> next state, state 0 is the root
+	std::vector<std::vector<int>> m_out;   // per state the patterns that end there, longest first
+};
@@ -17,19 +17,22 @@
 #include "VarArray.h"
 #include "log.h"
 #include "CodeDefinition.h"
+#include "ConstTable.h"
+#include "CycleCollector.h"
+#include "NameDict.h"
+#include "utils.h"
 
 #include <algorithm>
+#include <chrono>
+#include <climits>
 #include <iostream>
 #include <functional>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <sstream>
 #include <memory>
 
-#ifdef USE_BOOST
-#include <boost/container/flat_map.hpp>
-#endif
-
 #pragma warning(disable : 4355) // 'this' : used in base member initializer list
 
 class ModuleObject;
@@ -43,14 +46,6 @@ using ClassObjRef = PoolPtr<ClassObject>;
 
 using ModulesDict = std::map<std::string, ModuleObjRef>;
 
-#ifdef USE_BOOST
-using NameDict = boost::container::flat_map<std::string, ObjRef>;
-#else
-using NameDict = std::map<std::string, ObjRef>;
-#endif
-
-using IntDict = std::map<int64_t, ObjRef>;
-
 std::string stdstr(const ObjRef &vref, bool repr = false);
 void        print(const ObjRef &vref, std::ostream &out, bool repr);
 int         vmVersion();
@@ -75,28 +70,33 @@ public:
 		//if (g_maxStackSize < m_stack.size())
 		//    g_maxStackSize = static_cast<int>(m_stack.size());
 	}
+	void push(T &&ref) {
+		m_stack.push_back(std::move(ref));
+	}
 	
 	// push an element some distance from the top. pushAt(0,r) is equivalent to push(r)
-	void pushAt(int fromTop, const T &ref) {
+	void pushAt(int fromTop, T ref) {
 		CHECK(static_cast<int>(m_stack.size()) >= fromTop, "pushAt underflow");
 		//m_stack.insert(m_stack.size() - fromTop, ref);
-		m_stack.insert(m_stack.end() - fromTop, ref);
+		m_stack.insert(m_stack.end() - fromTop, std::move(ref));
 	}
 	
+	// the value is moved out of the stack so its count is not touched
 	T pop() {
 		CHECK(m_stack.size() > 0, "stack underflow");
-		ObjRef r = m_stack.back();
+		T r(std::move(m_stack.back()));
 		m_stack.pop_back();
 		return r;
 	}
 
 	// i - offset from the top. 0=TOS
-	T peek(int i) {
+	// returns a reference into the stack which is valid until the next push or pop. copy it to keep the value
+	const T &peek(int i) const {
 		CHECK(static_cast<int>(m_stack.size()) > i, "peek underflow");
 		return m_stack[m_stack.size() - 1 - i];
 	}
 	
-	T top() {
+	const T &top() const {
 		return peek(0);
 	}
 	
@@ -108,6 +108,11 @@ public:
 		m_stack.clear();
 	}
 	
+	template <typename F>
+	void foreach (F &&f) const {
+		m_stack.foreach (f);
+	}
+
 	std::vector<T> data() { // for testers
 		std::vector<T> r;
 		m_stack.foreach ([&](const T &v) { r.push_back(v); });
@@ -135,7 +140,9 @@ T tryLookup(const std::map<std::string, T> &d, const std::string &name) {
 	return it->second;
 }
 
-inline ObjRef tryLookup(const NameDict &d, const std::string &name) {
+// name is either a Name or a string that is looked up without being interned
+template <typename K>
+ObjRef tryLookup(const NameDict &d, const K &name) {
 	//++g_lookups[name];
 	auto it = d.find(name);
 	if (it == d.end())
@@ -150,13 +157,19 @@ T lookup(const std::map<std::string, T> &d, const std::string &name) {
 	return it->second;
 }
 
-inline ObjRef lookup(const NameDict &d, const std::string &name) {
+template <typename K>
+ObjRef lookup(const NameDict &d, const K &name) {
 	//++g_lookups[name];
 	auto it = d.find(name);
 	CHECK(it != d.end(), "KeyError: could not find `" << name << "`");
 	return it->second;
 }
 
+inline void traverseNameDict(const NameDict &d, const ObjVisitor &v) {
+	for (const auto &it : d)
+		visitRef(v, it.second);
+}
+
 //struct nullptrType {};
 //template<typename T>
 //struct IsType { enum { nullptrType = false; }; };
@@ -228,6 +241,9 @@ public:
 	ModuleObjRef getModule(const std::string &name);
 
 	ModuleObjRef importPycStream(std::istream &is, const std::string &path, bool hasHeader);
+	// the pyc is parsed in place, the span is not needed after this returns
+	ModuleObjRef importPycSpan(const ByteSpan &pyc, const std::string &path, bool hasHeader);
+	// maps the file, see mapFile()
 	ModuleObjRef importPycFile(const std::string &pycpath);
 	ModuleObjRef importPycBuf(const std::string &pyctext, bool hasHeader = false);
 
@@ -237,14 +253,19 @@ public:
 
 	void clear();
 
+	// the object is accounted in the memory of the vm with its size and payload, see setMemoryLimits()
 	ObjRef alloc(Object *o) {
-		return m_alloc.add(o);
+		return m_alloc.add(o, o->objectSize() + o->payloadSize());
+	}
+
+	// the immortal constants of loaded code, they live as long as the vm
+	ConstTable &constants() {
+		return m_constants;
 	}
 
 	template <typename T>
 	PoolPtr<T> alloct(T *t) {
-		Object *o = t;
-		ObjRef  r = m_alloc.add(o);
+		ObjRef r = alloc(t);
 		return static_pcast<T>(r);
 	}
 
@@ -267,6 +288,16 @@ public:
         return m_alloc.size();
 	}
 
+	// the memory quota of the vm. the bytes counted are the size of every object and what strings, lists and dicts
+	// allocate for their contents, updated as they grow. going over soft calls onSoft with the bytes used, once until
+	// the limits are set again. going over hard throws a MemoryError from the allocation that did it. 0 is no limit.
+	// interned names are shared by all vms and not counted, see Atom::bytes()
+	using TMemoryCallback = std::function<void(int64_t)>;
+	void    setMemoryLimits(int64_t soft, int64_t hard, TMemoryCallback onSoft = TMemoryCallback());
+	int64_t memoryUsed() const {
+		return m_alloc.bytes();
+	}
+
 	void validateCode(const CodeObjRef &def); // in instruction.cpp
 
 	ModuleObjRef mainModule() {
@@ -278,19 +309,35 @@ public:
 
 	std::string      instructionPointer();
 	ObjRef           lookupQual(const std::string &name, ModuleObjRef *mod);
+	// the name of s, interned if it is new. found in a cache of the vm first so that the names of keyword
+	// arguments don't go to the process-wide atom table on every call
+	Name name(const std::string &s);
+	// like name() but never interns, a null name if s was never interned
+	Name findName(const std::string &s);
 	ObjPool<Object> &objPool() {
 		return m_alloc;
 	}
+	CycleCollector &collector() {
+		return m_collector;
+	}
 	const ModulesDict &modules() const {
 		return m_modules;
 	}
 
 	// the import callback returns a pair with the stream to read the pyc from and a bool that says if the stream has a header
 	using TImportCallback = std::function<std::pair<std::unique_ptr<std::istream>, bool>(const std::string &)>;
+	// the same with the pyc as a span, a mapped file for instance. a span with null data is a module that wasn't found
+	using TImportSpanCallback = std::function<std::pair<ByteSpan, bool>(const std::string &)>;
+
+	class Region;
 
 	void setImportCallback(TImportCallback callback) {
 		m_importCallback = callback;
 	}
+	// tried before the stream callback
+	void setImportSpanCallback(TImportSpanCallback callback) {
+		m_importSpanCallback = callback;
+	}
 	Frame *currentFrame() {
 		return m_currentFrame;
 	}
@@ -305,9 +352,12 @@ private:
 	friend class OpImp;
 
 	ObjRef callFunction(Frame &from, int posCount, int kwCount);
+	void   overMemoryLimit(int64_t used);
 
 private:
-	ObjPool<Object> m_alloc; // must be first member so it would be destructed last, after all references are down
+	ConstTable      m_constants; // destructed after all objects that may reference them
+	ObjPool<Object> m_alloc; // must be destructed after all other members, after all references are down
+	CycleCollector  m_collector;
 
 	std::unique_ptr<StreamPrinter> m_out;
 	ModuleObjRef                   m_defaultModule; // module of __main__
@@ -315,6 +365,10 @@ private:
 	ModulesDict                    m_modules; // this is sys.modules
 	ObjRef                         m_noneObject, m_trueObject, m_falseObject;
 	TImportCallback                m_importCallback;
+	TImportSpanCallback            m_importSpanCallback;
+	int64_t                        m_hardLimit = 0;
+	TMemoryCallback                m_onSoftLimit; // reset once it was called
+	std::unordered_map<std::string, Name> m_names; // atoms already looked up, see name(). atoms are never freed
 
 	// used for debugging
 	Frame *m_currentFrame; // managed by Frame object c'tor and d'tor
@@ -331,29 +385,68 @@ int64_t hashStr(const std::string &s);
 // when it goes out of scope it calls 'clear()' for all objects created after it's instantiation
 // This clears out any reference circles which occured in the run of the python code to avoid memory leaks.
 // NOTICE: this also means that there should not be globally referenced objects created in that scope.
+// the clearing can also be spread over time: close() ends the scope, then step() clears it a slice at a time,
+// between requests for instance. objects created after close() are not part of the scope and are never cleared.
+// whatever is left is cleared in the destructor
 class StateClearer {
 public:
 	StateClearer(PyVM *vm)
-		: m_vm(vm), m_savedHead(vm->objPool().listHead()) {
+		: m_vm(vm), m_epoch(vm->objPool()) {
 	}
 	~StateClearer() {
 		try {
-			bool tillend = m_vm->objPool().foreach ([this](const ObjRef &o) -> bool {
-				if (o.get() == m_savedHead.get())
-					return false; // stop iteration
-				o->clear();
-				return true;
-			});
-			if (tillend)
-				LOG_ERROR("!!!!! StateClearer went too far (did not find savedHead)");
+			while (!step(INT_MAX))
+				;
 		} catch (const PyException &e) {
 			LOG_ERROR("!!!!! Caught exception in StateClearer ", e.what());
 		}
 	}
 
+	// end the scope, objects created from now on are not cleared. called by the first step() if it wasn't called
+	void close() {
+		if (!m_end)
+			m_end.reset(new ObjPool<Object>::Epoch(m_vm->objPool()));
+	}
+	// clear at most maxObjects of the objects of the scope. returns true when all of them are cleared
+	bool step(int maxObjects);
+	// clear objects of the scope until deadline. returns true when all of them are cleared
+	bool step(std::chrono::steady_clock::time_point deadline);
+
 private:
-	ObjRef m_savedHead;
-	PyVM * m_vm;
+	PyVM *                                  m_vm;
+	ObjPool<Object>::Epoch                  m_epoch; // the next object to clear
+	std::unique_ptr<ObjPool<Object>::Epoch> m_end;
+};
+
+// successor of StateClearer, also instantiated on the stack around a request-like execution.
+// when it goes out of scope it finds which of the objects created in it are still referenced from outside of it
+// (older objects, C++ code, enclosing frames). these have escaped the scope and stay in the pool untouched, along with
+// everything they reference. all other objects created in the scope are garbage, possibly in reference cycles.
+// they are cleared and freed together.
+// unlike StateClearer, it is safe to keep a reference to an object created in the scope in a global variable.
+class PyVM::Region {
+public:
+	Region(PyVM *vm)
+		: m_vm(vm), m_epoch(vm->objPool()) {
+	}
+	~Region() {
+		try {
+			release();
+		} catch (const PyException &e) {
+			LOG_ERROR("!!!!! Caught exception in Region ", e.what());
+		}
+	}
+
+	// free the garbage of the scope now. returns the number of objects that escaped the scope.
+	// does nothing when called again.
+	int release();
+
+private:
+	DISALLOW_COPY_AND_ASSIGN(Region)
+	PyVM *                 m_vm;
+	ObjPool<Object>::Epoch m_epoch;
+	bool                   m_released = false;
+	int                    m_escaped  = 0;
 };
 
 struct Block {
@@ -371,7 +464,7 @@ struct CallArgs {
 	TPosVector pos;
 	NameDict   kw;
 
-	ObjRef operator[](int i) {
+	const ObjRef &operator[](int i) const {
 		return pos[i];
 	}
 	void posReverse() {
@@ -396,12 +489,16 @@ public:
 	void push(const ObjRef &ref) {
 		m_stack.push(ref);
 	}
+	void push(ObjRef &&ref) {
+		m_stack.push(std::move(ref));
+	}
 
 	ObjRef pop() {
 		return m_stack.pop();
 	}
 
-	ObjRef top() {
+	// valid until the next push or pop
+	const ObjRef &top() const {
 		return m_stack.top();
 	}
 
@@ -426,7 +523,9 @@ public:
 	}
 
 	void   doOpcode(SetObjCallback &setObj);
-	ObjRef lookupGlobal(const std::string &name);
+	ObjRef lookupGlobal(const Name &name);
+	// if the next instruction stores to a variable that holds o, drop that reference now
+	void releaseStoreTarget(const ObjRef &o);
 
 	void argsFromStack(Frame &from, int posCount, int kwCount, CallArgs &args);
 	// void localsFromArgs(const std::vector<ObjRef>& args);
@@ -437,11 +536,16 @@ public:
 	ObjRef    run();
 
 	void clear();
+	void traverse(const ObjVisitor &v);
 
 	void              setCode(const CodeObjRef &code);
 	const CodeObjRef &code() {
 		return m_code;
 	}
+	// the result of LOAD_ATTR at a call temp site, see CodeObject::m_callTemps
+	ObjRef callTempAttr(const ObjRef &o, const Name &name);
+	// drop what the temps reference once the call is done, so they don't keep anything alive
+	void releaseCallTemps();
 
 public:
 	uint               m_lasti = 0;  // index in the code object string of the curret instruction
@@ -459,4 +563,7 @@ public:
 private:
 	CodeObjRef      m_code;
 	TFastLocalsList m_fastlocals;
+	// a bound method and a PrimitiveAttrAdapter that call temp sites reuse for as long as nothing else keeps
+	// them, so a method called in a loop is not made anew on every iteration. released with the frame
+	ObjRef m_callMethod, m_callAdapter;
 };
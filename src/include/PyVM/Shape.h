@@ -0,0 +1,64 @@
+// Copyright 2015 by Intigua, Inc.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "Atom.h"
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+// the hidden class of an instance: the names of its attributes in the order they were first assigned.
+// instances that got the same attributes in the same order share a Shape and store only the values, by slot.
+// every class owns the root of a transition tree of shapes, assigning a new attribute moves an instance
+// to a child shape. the tree is bounded, when a limit is hit withAdded() returns nullptr and the instance
+// keeps its attributes in a NameDict instead
+class Shape {
+public:
+	enum {
+		MAX_SLOTS = 32,       // an instance with more attributes than this uses a dictionary
+		MAX_TRANSITIONS = 16, // a shape that is extended in more ways than this is not extended further
+	};
+
+	Shape()
+		: m_parent(nullptr) {}
+
+	// returns -1 if name is not in this shape
+	int slotOf(const Name &name) const {
+		const Atom *a = name.atom();
+		for (size_t i = 0; i < m_names.size(); ++i)
+			if (m_names[i].atom() == a)
+				return (int)i;
+		return -1;
+	}
+
+	// the shape with name added as the last slot, nullptr if the tree got too big
+	Shape *withAdded(const Name &name);
+
+	int size() const {
+		return (int)m_names.size();
+	}
+	const Name &nameAt(int slot) const {
+		return m_names[slot];
+	}
+	const Shape *parent() const {
+		return m_parent;
+	}
+
+private:
+	Shape(const Shape *parent, const Name &name);
+
+	const Shape                                          *m_parent;
+	std::vector<Name>                                     m_names;
+	std::vector<std::pair<Name, std::unique_ptr<Shape>>> m_transitions;
+	DISALLOW_COPY_AND_ASSIGN(Shape)
+};
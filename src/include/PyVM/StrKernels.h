@@ -0,0 +1,34 @@
+// Copyright 2015 by Intigua, Inc.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// scanning kernels for byte strings that work on the original string instead of on a converted copy.
+// case folding is ascii only, which is what toLower() does for bytes in the C locale.
+// on x86 they use SSE2 and, when the cpu has it, AVX2. the choice is made once, on the first call
+
+// a and b are equal ignoring ascii case, both n bytes long
+bool iEqualsAscii(const char *a, const char *b, size_t n);
+
+// position of the first occurance of needle in hay ignoring ascii case, npos if none
+size_t iFindAscii(const char *hay, size_t n, const char *needle, size_t m);
+
+// position of the first ' ', '\t', '\n' or '\r' in p, n if none
+size_t findWhitespace(const char *p, size_t n);
+
+// position of the first x in p, n if none. for the membership test of an unboxed int list
+size_t findInt64(const int64_t *p, size_t n, int64_t x);
+
+// for tests, the name of the kernel set in use: "avx2", "sse2" or "scalar"
+const char *strKernelsName();
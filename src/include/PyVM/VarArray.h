@@ -14,18 +14,47 @@
 #include "defs.h"
 #include "except.h"
 
+#include <utility>
+
 // based on QVarLengthArray from QT
-// doesn't yet support move semantics
+// elements are moved, not copied, when the array grows or shrinks
 template <typename T, int StaticSize>
 class VarArray {
 public:
 	VarArray()
 		: m_alloc(StaticSize), m_ptr(reinterpret_cast<T *>(m_arrbuf)) {}
 
+	VarArray(VarArray &&o)
+		: m_alloc(StaticSize), m_ptr(reinterpret_cast<T *>(m_arrbuf)) {
+		*this = std::move(o);
+	}
+
 	~VarArray() {
 		clear();
 	}
 
+	// takes the allocated buffer of o or moves its elements if they are in the static buffer
+	VarArray &operator=(VarArray &&o) {
+		if (&o == this)
+			return *this;
+		clear();
+		if (o.m_allocbuf != nullptr) {
+			m_allocbuf   = o.m_allocbuf;
+			m_ptr        = o.m_ptr;
+			m_size       = o.m_size;
+			m_alloc      = o.m_alloc;
+			o.m_allocbuf = nullptr;
+			o.m_ptr      = reinterpret_cast<T *>(o.m_arrbuf);
+			o.m_size     = 0;
+			o.m_alloc    = StaticSize;
+		} else {
+			for (; m_size < o.m_size; ++m_size)
+				new (m_ptr + m_size) T(std::move(o.m_ptr[m_size]));
+			o.clear();
+		}
+		return *this;
+	}
+
 	using iterator =  T *;
 	using value_type = T;
 	using const_iterator = const T *;
@@ -58,10 +87,22 @@ public:
 	}
 
 	void push_back(const T &v) {
-		incAlloc();
-		int idx = m_size++;
-		// placement new running copy constructor
-		new (m_ptr + idx) T(v);
+		emplace_back(v);
+	}
+
+	void push_back(T &&v) {
+		emplace_back(std::move(v));
+	}
+
+	template <typename... Args>
+	T &emplace_back(Args &&... args) {
+		if (m_size == m_alloc) {
+			T v(std::forward<Args>(args)...); // args may refer to an element which is about to be moved
+			incAlloc();
+			new (m_ptr + m_size) T(std::move(v));
+		} else
+			new (m_ptr + m_size) T(std::forward<Args>(args)...);
+		return m_ptr[m_size++];
 	}
 
 	void pop_back() {
@@ -80,7 +121,8 @@ public:
 		return m_ptr[m_size - 1];
 	}
 
-	void insert(iterator before, const T &v) {
+	// v is taken by value since it may refer to an element of the array
+	void insert(iterator before, T v) {
 		auto beforeIdx = int(before - m_ptr);
 		ASSERT(beforeIdx >= 0 && beforeIdx <= m_size, "Unexpected beforeIdx ");
 
@@ -95,16 +137,21 @@ public:
 		while (src != base) {
 			--dst;
 			--src;
-			*dst = *src;
+			*dst = std::move(*src);
 		}
-		// just copied from src which is base, can set value to base
-		*base = v;
+		// just moved from src which is base, can set value to base
+		*base = std::move(v);
 	}
 
 	int size() const {
 		return m_size;
 	}
 
+	// the bytes allocated when the elements don't fit in the static buffer
+	size_t heapSize() const {
+		return (m_allocbuf != nullptr) ? m_alloc * sizeof(T) : 0;
+	}
+
 	T &operator[](int idx) {
 		ASSERT(idx >= 0 && idx < m_size, "Unexpected idx");
 		return m_ptr[idx];
@@ -153,17 +200,17 @@ private:
 		int       oldSize  = m_size;
 		const int copySize = std::min(newSize, oldSize);
 
-		if (newAlloc != m_alloc) // need to copy stuff
+		if (newAlloc != m_alloc) // need to move stuff
 		{
 			m_allocbuf = new char[newAlloc * sizeof(T)];
 			m_ptr      = reinterpret_cast<T *>(m_allocbuf);
 			m_size     = 0;
 			m_alloc    = newAlloc;
 
-			// copy all the old elements
+			// move all the old elements
 			try {
 				while (m_size < copySize) {
-					new (m_ptr + m_size) T(*(oldPtr + m_size)); // copy c'tor. can throw
+					new (m_ptr + m_size) T(std::move(*(oldPtr + m_size))); // can throw if T has no move c'tor
 					(oldPtr + m_size)->~T();
 					m_size++;
 				}
@@ -12,29 +12,18 @@
 #pragma once
 
 #include "ObjPool.h"
+#include "Atom.h"
 #include "except.h"
 
+#include <functional>
+
 struct Object;
 using ObjRef = PoolPtr<Object>;
+// called with every object directly referenced by another object, see Object::traverse()
+using ObjVisitor = std::function<void(Object *)>;
 class Frame;
 class PyVM;
 
-// Base Object inherits from these but and throw an exception
-// objects that are really supposed to inherit from these have IATTRABLE oe ICALLABLE
-// in typeProp. this is to avoid a consty dynamic_cast<> and to be able to implement my
-// own cheap dynamic_cast<> using this bitmask.
-
-struct IAttrable {
-	// try to lookup the name, if not found, return nullptr ref
-	virtual ObjRef attr(const std::string &name)                     = 0;
-	virtual void   setattr(const std::string &name, const ObjRef &o) = 0;
-};
-
-struct ICallable {
-	virtual ObjRef      call(Frame &from, Frame &frame, int posCount, int kwCount, const ObjRef &self) = 0;
-	virtual std::string funcname() const                                                               = 0; // for logging
-};
-
 //#define PYVM_COUNT_OBJECTS
 
 #ifdef PYVM_COUNT_OBJECTS
@@ -43,9 +32,17 @@ struct ICallable {
 extern int g_pyvmObjectCount;
 #endif
 
+// goes in the body of every class of objects, so Object::objectSize() is the size of the type the object was made as
+#define DEFINE_OBJECT_SIZE                  \
+	size_t objectSize() const override { \
+		return sizeof(*this);               \
+	}
+
 // this is a superset of ConstValue from proto
-struct Object : public IAttrable, public ICallable {
+// the header of every object is a vptr and the 8 bytes of RefCount, which also hold the type, see type()
+struct Object {
 public:
+	// stored in the 6 bits of RefCount::user
 	enum Type {
 		NONE              = 0,
 		BOOL              = 1,
@@ -73,14 +70,14 @@ public:
 		XRANGE            = 23
 	};
 
+	// objects of types that have IATTRABLE or ICALLABLE implement attr(), setattr() or call(), funcname().
+	// others throw an exception. this is used instead of a costy dynamic_cast
 	enum TypeProp {
-		IATTRABLE = 1, // see tryAs<IAttrable>
+		IATTRABLE = 1,
 		ICALLABLE = 2
 	};
 
 	RefCount<Object> count;
-	Type             type;
-	int              typeProp; // used instead of costy dynamic_cast
 
 public:
 	virtual ~Object() {
@@ -91,34 +88,43 @@ public:
 
 	// clear all internal references of an object, to cleanup any reference cycle
 	// must only call 'reset()' of held ObjRefs. never recursively call other objects clear() since that could cause infinite recursion
-	Object(Type _type = NONE)
-		: type(_type), typeProp(0) {
+	Object(Type _type = NONE) {
+		count.user = _type;
 #ifdef PYVM_COUNT_OBJECTS
 		g_pyvmObjectCount++;
 #endif
 	}
 
-	Object(Type _type, uint _typeProp)
-		: type(_type), typeProp(_typeProp) {
-#ifdef PYVM_COUNT_OBJECTS
-		g_pyvmObjectCount++;
-#endif
+	Type type() const {
+		return (Type)count.user;
 	}
+	int typeProp() const {
+		return typeProp(type());
+	}
+	static int typeProp(Type t);
 
 	virtual void clear() {}
 
-	ObjRef attr(const std::string &name) override {
+	// call v for every object this object holds a reference to. this is the read-only counterpart of clear()
+	// and is used to find out which objects are referenced from outside a group of objects (see PyVM::Region)
+	// missing a reference here is safe (the object is just assumed to be referenced from outside), reporting one that doesn't exist is not.
+	virtual void traverse(const ObjVisitor &v) {
+		(void)v;
+	}
+
+	// try to lookup the name, if not found, return nullptr ref
+	virtual ObjRef attr(const Name &name) {
 		(void)name;
 		THROW("Unimplemented Object::attr");
 	}
 
-	void setattr(const std::string &name, const ObjRef &o) override {
+	virtual void setattr(const Name &name, const ObjRef &o) {
 		(void)name;
 		(void)o;
 		THROW("Unimplemented Object::setattr");
 	}
 
-	ObjRef call(Frame &from, Frame &frame, int posCount, int kwCount, const ObjRef &self) override {
+	virtual ObjRef call(Frame &from, Frame &frame, int posCount, int kwCount, const ObjRef &self) {
 		(void)from;
 		(void)frame;
 		(void)posCount;
@@ -127,27 +133,45 @@ public:
 		THROW("Unimplemented Object::call");
 	}
 
-	std::string funcname() const override {
+	// for logging
+	virtual std::string funcname() const {
 		THROW("Unimplemented Object::funcname");
 	}
 
+	// the size of the object itself, see DEFINE_OBJECT_SIZE
+	virtual size_t objectSize() const {
+		return sizeof(Object);
+	}
+	// the bytes the object allocated for its contents, counted with its size in the memory of the vm (see PyVM::setMemoryLimits())
+	virtual size_t payloadSize() const {
+		return 0;
+	}
+	// call after payloadSize() changed from before. may throw a MemoryError, so call it when the object is consistent
+	void payloadChanged(size_t before) {
+		ObjPool<Object>::resized(this, (int64_t)payloadSize() - (int64_t)before);
+	}
+
 public:
 	template <typename T>
 	static Object::Type typeValue();
 
+	bool hasProp(Object::TypeProp p) const {
+		return checkFlag(typeProp(), (int)p);
+	}
+
 	void checkType(Object::Type t) {
-		CHECK(type == t, "wrong type expected:" << typeName(t) << " got:" << typeName());
+		CHECK(type() == t, "wrong type expected:" << typeName(t) << " got:" << typeName());
 	}
 
 	void checkProp(Object::TypeProp p) {
-		CHECK(checkFlag(typeProp, (int)p) == true, "wrong prop expected:" << typeProp << " got:" << p);
+		CHECK(hasProp(p), "wrong prop expected:" << p << " got:" << typeProp());
 	}
 
 	template <typename T> // T is a primitive type like int or string
 	inline void checkTypeT();
 
 	const char *typeName() {
-		return typeName(type);
+		return typeName(type());
 	}
 	static const char *typeName(Type t);
 
@@ -174,18 +198,27 @@ private:
 	DISALLOW_COPY_AND_ASSIGN(Object)
 };
 
-template <>
-inline IAttrable *Object::tryAs<IAttrable>() {
-	if (checkFlag(typeProp, (int)IATTRABLE)) {
-		return static_cast<IAttrable *>(this);
+static_assert(sizeof(Object) == sizeof(void *) + sizeof(RefCount<Object>), "object header should be a vptr and a RefCount");
+
+inline int Object::typeProp(Type t) {
+	switch (t) {
+	case FUNC:
+	case METHOD:
+	case PRIMITIVE_ADAPTER:
+	case GENERATOR:
+		return ICALLABLE;
+	case CLASS:
+		return ICALLABLE | IATTRABLE;
+	case MODULE:
+	case INSTANCE:
+		return IATTRABLE;
+	default:
+		return 0;
 	}
-	return nullptr;
 }
 
-template <>
-inline ICallable *Object::tryAs<ICallable>() {
-	if (checkFlag(typeProp, (int)ICALLABLE)) {
-		return static_cast<ICallable *>(this);
-	}
-	return nullptr;
+template <typename T>
+inline void visitRef(const ObjVisitor &v, const PoolPtr<T> &r) {
+	if (!r.isNull())
+		v(r.get());
 }
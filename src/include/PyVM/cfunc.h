@@ -20,6 +20,7 @@
 
 template <int Acount, typename TL>
 struct CWrap : public ICWrap {
+	DEFINE_OBJECT_SIZE
 
     CWrap(TL f) : m_f(f) {}
 
@@ -86,7 +87,7 @@ ICWrapPtr makeCWrap( R(*f)(As...), PyVM* vm) {
     return makeWrap<sizeof...(As)>(vm, [=](CallArgs& args)->ObjRef {
         save_func_for_later<R, As...> saved = { f };
         R ret = saved.delayed_dispatch(args);
-        return vm->makeFromT<R>(ret);
+        return vm->makeFromT<R>(std::forward<R>(ret));
     });
 }
 
@@ -207,7 +208,7 @@ ICWrapPtr makeCWrap(R(C::*f)(As...), PyVM* vm) {
         save_method_for_later<C, R, As...> saved = { f };
         C* self = extractCInst<C>(args[sizeof...(As)]);
         R ret = saved.delayed_dispatch(args, self);
-        return vm->makeFromT<R>(ret);
+        return vm->makeFromT<R>(std::forward<R>(ret));
     });
 }
 
@@ -234,7 +235,7 @@ ICWrapPtr makeCWrap( R(C::*f)(const std::vector<ObjRef>&), PyVM* vm) {
         args.posReverse();
         std::vector<ObjRef> argsCopy(args.pos.begin(), args.pos.end());
         R ret = (self->*f)(argsCopy);
-        return vm->makeFromT<R>(ret);
+        return vm->makeFromT<R>(std::forward<R>(ret));
     });
 }
 
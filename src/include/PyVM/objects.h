@@ -15,6 +15,8 @@
 #include "except.h"
 #include "ObjPool.h"
 #include "PyVM.h"
+#include "Shape.h"
+#include "ObjDict.h"
 #include "utils.h"
 
 
@@ -30,7 +32,7 @@ inline bool isStrType(Object::Type t) {
 	return t == Object::STR || t == Object::USTR;
 }
 
-#define CHECK_TYPE(r, T) CHECK(r->type == Object::typeValue<T>(), "wrong type cast expected " << Object::typeName<T>() << ", got " << r->typeName())
+#define CHECK_TYPE(r, T) CHECK(r->type() == Object::typeValue<T>(), "wrong type cast expected " << Object::typeName<T>() << ", got " << r->typeName())
 
 // these should be preferred over costy dynamic_cast
 template <typename T> // an Object type
@@ -74,12 +76,14 @@ public:
 };
 
 struct BoolObject : public Object {
+	DEFINE_OBJECT_SIZE
 	BoolObject(bool _v)
 		: Object(BOOL), v(_v) {}
 	bool v;
 };
 
 struct IntObject : public Object {
+	DEFINE_OBJECT_SIZE
 	IntObject(uint _v)
 		: Object(INT), v(_v) {}
 	IntObject(int _v)
@@ -92,6 +96,7 @@ struct IntObject : public Object {
 };
 
 struct FloatObject : public Object {
+	DEFINE_OBJECT_SIZE
 	FloatObject(double _v)
 		: Object(FLOAT), v(_v) {}
 	double v;
@@ -112,6 +117,7 @@ struct IIterator {
 };
 
 struct IteratorObject : public Object, IIterator {
+	DEFINE_OBJECT_SIZE
 	IteratorObject()
 		: Object(ITERATOR) {}
 	// if there is a next object, set obj to it and return true. if we're at the end, return false.
@@ -128,11 +134,15 @@ struct IIterable {
 // an iterator over an object. the object needs to have a member 'v' which is an c++ sequence
 template <typename T>
 struct GenericIterObject : public IteratorObject, public IIterable {
+	DEFINE_OBJECT_SIZE
 	GenericIterObject(const PoolPtr<T> &l, PyVM *vm)
 		: of(l), m_vm(vm) {}
 	void clear() override {
 		of.reset();
 	}
+	void traverse(const ObjVisitor &v) override {
+		visitRef(v, of);
+	}
 	bool next(ObjRef &obj) override {
 		if (i >= (int)of->v.size())
 			return false;
@@ -160,6 +170,7 @@ struct GenericIterable : public IIterable {
 
 template <typename T>
 struct MapIterObject : public IteratorObject, public IIterable {
+	DEFINE_OBJECT_SIZE
 	MapIterObject(const PoolPtr<T> &l, PyVM *vm)
 		: of(l), m_vm(vm) {
 		i = of->v.begin();
@@ -168,6 +179,9 @@ struct MapIterObject : public IteratorObject, public IIterable {
 	void clear() override {
 		of.reset();
 	}
+	void traverse(const ObjVisitor &v) override {
+		visitRef(v, of);
+	}
 
 	bool next(ObjRef &obj) override {
 		if (i == of->v.end())
@@ -199,9 +213,12 @@ struct MapIterable : public IIterable {
 
 class SliceObject : public Object {
 public:
+	DEFINE_OBJECT_SIZE
 	SliceObject(bool h_start, int _start, bool h_stop, int _stop, bool h_step, int _step)
 		: Object(SLICE), has_start(h_start), start(_start), has_stop(h_stop), stop(_stop), has_step(h_step), step(_step) {}
 
+	// normalizes start, stop and step for a sequence of the given length and returns the length of the slice
+	int indices(int length);
 	template <typename T>
 	T slice_step(const T &o);
 
@@ -212,13 +229,12 @@ public:
 using SliceObjRef = PoolPtr<SliceObject>;
 
 // inspired by CPython PySlice_GetIndicesEx() in sliceobject.c
-template <typename T>
-T SliceObject::slice_step(const T &o) {
+inline int SliceObject::indices(int length) {
 	if (!has_step)
 		step = 1;
-	int length = (int)o.size();
+	CHECK(step != 0, "ValueError: slice step cannot be zero");
 	if (!has_start)
-		start = step < 0 ? length : 0;
+		start = step < 0 ? length - 1 : 0;
 	else {
 		if (start < 0) start += length;
 		if (start < 0) start = (step < 0) ? -1 : 0;
@@ -234,14 +250,22 @@ T SliceObject::slice_step(const T &o) {
 			stop = (step < 0) ? length - 1 : length;
 	}
 
-	T   res;
-	int slicelength;
 	if ((step < 0 && stop >= start) || (step > 0 && start >= stop))
-		return res; // len = 0
+		return 0;
 	else if (step < 0)
-		slicelength = (stop - start + 1) / step + 1;
+		return (stop - start + 1) / step + 1;
 	else
-		slicelength = (stop - start - 1) / step + 1;
+		return (stop - start - 1) / step + 1;
+}
+
+template <typename T>
+T SliceObject::slice_step(const T &o) {
+	int slicelength = indices((int)o.size());
+	if (slicelength == 0)
+		return T();
+	if (step == 1) // contiguous, a single range copy
+		return T(o.begin() + start, o.begin() + start + slicelength);
+	T res;
 	res.resize(slicelength);
 	for (int cur = start, i = 0; i < slicelength; cur += step, ++i) {
 		res[i] = o[cur];
@@ -255,8 +279,12 @@ template <typename T, typename ElemT>
 struct GenericSubscriptable : public ISubscriptable {
 	ObjRef getSubscr(const ObjRef &key, PyVM *vm) override {
 		auto &tv = static_cast<T *>(this)->v;
-		if (key->type == Object::SLICE) {
-			return vm->makeFromT(static_pcast<SliceObject>(key)->slice_step(tv));
+		if (key->type() == Object::SLICE) {
+			auto *slice = static_cast<SliceObject *>(key.get());
+			// str, unicode and tuple are immutable so a slice of all of them is the object itself, like in CPython
+			if (static_cast<T *>(this)->type() != Object::LIST && slice->indices((int)tv.size()) == (int)tv.size() && slice->step == 1)
+				return ObjRef(static_cast<T *>(this));
+			return vm->makeFromT(slice->slice_step(tv));
 		}
 		return vm->makeFromT(tv[extractIndex(key, tv.size())]);
 	}
@@ -264,17 +292,30 @@ struct GenericSubscriptable : public ISubscriptable {
 };
 
 struct StrBaseObject : public Object {
+	DEFINE_OBJECT_SIZE
 	StrBaseObject(Object::Type t)
 		: Object(t) {}
 	virtual int    at(int i) const = 0;
 	virtual int    size() const    = 0;
 	virtual size_t ptr() const     = 0;
+
+	// computed by hashNum() on first use. a string must not be changed once it was hashed
+	mutable int64_t cachedHash = -1;
 };
 
+// the bytes s allocated, none while it is short enough to be kept inside of s
+template <typename TC>
+size_t strPayloadSize(const std::basic_string<TC> &s) {
+	const char *d = (const char *)s.data();
+	if (d >= (const char *)&s && d < (const char *)(&s + 1))
+		return 0;
+	return (s.capacity() + 1) * sizeof(TC);
+}
+
 enum StrModifier {
 	STRMOD_NONE,  // get the string as it is
 	STRMOD_CASEI, // get lower-case versin of the string
-	STRMOD_PATH   // path normalized version of the string (only on windows)
+	STRMOD_PATH   // path normalized version of the string, see pathNormalized()
 };
 
 // various caches for an StrObject (ansi)
@@ -283,6 +324,10 @@ struct StrExtension {
 		: v(_v), has_iv(false), has_pathv(false), has_wv(false), has_wiv(false), has_wpathv(false) {}
 	bool               has_iv, has_pathv, has_wv, has_wiv, has_wpathv;
 	const std::string *v;
+
+	size_t payloadSize() const {
+		return sizeof(*this) + strPayloadSize(iv) + strPayloadSize(pathv) + strPayloadSize(wv) + strPayloadSize(wiv) + strPayloadSize(wpathv);
+	}
 	std::string        iv;     // lower case ansi
 	std::string        pathv;  // path-normalized ansi
 	std::wstring       wv;     // wide-char cache
@@ -297,13 +342,13 @@ struct StrExtension {
 			}
 			return &iv;
 		}
-		/* TBD     if (mod == STRMOD_PATH) { // active only in windows see PATH_MODIFIER_
-            if (!has_pathv) {
-                pathv = os::FSUtils::pathNormalized(*v, os::FSUtils::LOW_CASE);
-                has_pathv = true;
-            }
-            return &pathv;
-        }*/
+		if (mod == STRMOD_PATH) {
+			if (!has_pathv) {
+				pathv     = pathNormalized(*v);
+				has_pathv = true;
+			}
+			return &pathv;
+		}
 		THROW("Unexpected string (StrE) modifier" << mod);
 	}
 	std::wstring *getWStr(StrModifier mod) {
@@ -321,18 +366,19 @@ struct StrExtension {
 			}
 			return &wiv;
 		}
-		/*   TBD     if (mod == STRMOD_PATH) { // active only in windows see PATH_MODIFIER_
-            if (!has_wpathv) {
-                wpathv = os::FSUtils::pathNormalized(wv, os::FSUtils::LOW_CASE);
-                has_wpathv = true;
-            }
-            return &wpathv;
-        }*/
+		if (mod == STRMOD_PATH) {
+			if (!has_wpathv) {
+				wpathv     = pathNormalized(wv);
+				has_wpathv = true;
+			}
+			return &wpathv;
+		}
 		THROW("Unexpected std::wstring (StrE) modifier" << mod);
 	}
 };
 
 struct StrObject : public StrBaseObject, public GenericIterable<StrObject>, public GenericSubscriptable<StrObject, char> {
+	DEFINE_OBJECT_SIZE
 	StrObject()
 		: StrBaseObject(STR) {}
 
@@ -341,7 +387,12 @@ struct StrObject : public StrBaseObject, public GenericIterable<StrObject>, publ
 
 	explicit StrObject(const std::string &_v)
 		: StrBaseObject(STR), v(_v) {}
+	explicit StrObject(std::string &&_v)
+		: StrBaseObject(STR), v(std::move(_v)) {}
 
+	size_t payloadSize() const override {
+		return strPayloadSize(v) + (ext ? ext->payloadSize() : 0);
+	}
 	int size() const override {
 		return (int)v.size();
 	}
@@ -354,19 +405,37 @@ struct StrObject : public StrBaseObject, public GenericIterable<StrObject>, publ
 		return (size_t)v.data();
 	}
 
+	// the caches are counted in the payload
 	const std::string *getStr(StrModifier mod) {
 		if (mod == STRMOD_NONE)
 			return &v;
+		size_t before = payloadSize();
 		if (ext.get() == nullptr)
 			ext.reset(new StrExtension(&v));
-		return ext->getStr(mod);
+		const std::string *r = ext->getStr(mod);
+		payloadChanged(before);
+		return r;
 	}
 
 	const std::wstring *getWStr(StrModifier mod) {
 		// STRs are immutable so it's ok to cache it once
+		size_t before = payloadSize();
 		if (ext.get() == nullptr)
 			ext.reset(new StrExtension(&v));
-		return ext->getWStr(mod);
+		const std::wstring *r = ext->getWStr(mod);
+		payloadChanged(before);
+		return r;
+	}
+
+	// call after v was changed in place, which is allowed only while no one else references the string.
+	// drops the caches, call it before taking the payloadSize() of the change
+	void changed() {
+		cachedHash = -1;
+		if (ext) {
+			size_t before = payloadSize();
+			ext.reset();
+			payloadChanged(before);
+		}
 	}
 
 	std::string                   v;
@@ -385,6 +454,10 @@ struct UnicodeExtension {
 	std::wstring        wiv;    // lower case wide-char
 	std::wstring        wpathv; // path-normalized wide-char
 
+	size_t payloadSize() const {
+		return sizeof(*this) + strPayloadSize(wiv) + strPayloadSize(wpathv);
+	}
+
 	std::wstring *getWStr(StrModifier mod) {
 		if (mod == STRMOD_CASEI) {
 			if (!has_wiv) {
@@ -393,13 +466,13 @@ struct UnicodeExtension {
 			}
 			return &wiv;
 		}
-		/*     if (mod == STRMOD_PATH) {
-            if (!has_wpathv) {
-                wpathv = os::FSUtils::pathNormalized(*wv, os::FSUtils::LOW_CASE);
-                has_wpathv = true;
-            }
-            return &wpathv;
-        }*/
+		if (mod == STRMOD_PATH) {
+			if (!has_wpathv) {
+				wpathv     = pathNormalized(*wv);
+				has_wpathv = true;
+			}
+			return &wpathv;
+		}
 		THROW("Unexpected std::wstring (UnicodeE) modifier" << mod);
 	}
 };
@@ -409,12 +482,15 @@ enum EEncoding {
 	ENC_ASCII = 1
 };
 struct UnicodeObject : public StrBaseObject, public GenericIterable<UnicodeObject>, public GenericSubscriptable<UnicodeObject, wchar_t> {
+	DEFINE_OBJECT_SIZE
 	UnicodeObject()
 		: StrBaseObject(USTR) {}
 	explicit UnicodeObject(wchar_t c)
 		: StrBaseObject(USTR), v(1, c) {}
 	explicit UnicodeObject(const std::wstring &_v)
 		: StrBaseObject(USTR), v(_v) {}
+	explicit UnicodeObject(std::wstring &&_v)
+		: StrBaseObject(USTR), v(std::move(_v)) {}
 	UnicodeObject(const std::string &_v, EEncoding enc)
 		: StrBaseObject(USTR) {
 		if (enc == ENC_UTF8)
@@ -429,6 +505,9 @@ struct UnicodeObject : public StrBaseObject, public GenericIterable<UnicodeObjec
 
 	static ObjRef fromStr(const ObjRef &s, PyVM *vm);
 
+	size_t payloadSize() const override {
+		return strPayloadSize(v) + (ext ? ext->payloadSize() : 0);
+	}
 	int size() const override {
 		return (int)v.size();
 	}
@@ -441,48 +520,130 @@ struct UnicodeObject : public StrBaseObject, public GenericIterable<UnicodeObjec
 		return (size_t)v.data();
 	}
 
+	// the caches are counted in the payload
 	const std::wstring *getWStr(StrModifier mod) {
 		if (mod == STRMOD_NONE)
 			return &v;
+		size_t before = payloadSize();
 		if (ext.get() == nullptr)
 			ext.reset(new UnicodeExtension(&v));
-		return ext->getWStr(mod);
+		const std::wstring *r = ext->getWStr(mod);
+		payloadChanged(before);
+		return r;
+	}
+
+	// call after v was changed in place, which is allowed only while no one else references the string.
+	// drops the caches, call it before taking the payloadSize() of the change
+	void changed() {
+		cachedHash = -1;
+		if (ext) {
+			size_t before = payloadSize();
+			ext.reset();
+			payloadChanged(before);
+		}
 	}
 
 	std::wstring                      v;
 	std::unique_ptr<UnicodeExtension> ext;
 };
 
-struct ListObject : public Object, public GenericSubscriptable<ListObject, ObjRef>, public GenericIterable<ListObject> {
+// a list made by python code stores its elements unboxed while they are all ints or all floats, see Strategy.
+// an element is boxed again into a new object when it is read. the first element of another type switches the
+// list to the generic storage for good, objects() does that too. tuples and lists made by C++ code always use
+// the generic storage unless allowUnboxed() is called.
+struct ListObject : public Object, public ISubscriptable, public IIterable {
+	DEFINE_OBJECT_SIZE
+	enum Strategy {
+		OBJECTS, // m_objs
+		INTS,    // m_ints
+		FLOATS   // m_floats
+	};
+
 	ListObject(const std::vector<ObjRef> &o)
-		: Object(LIST), v(o) {}
+		: Object(LIST), m_objs(o) {}
+	ListObject(std::vector<ObjRef> &&o)
+		: Object(LIST), m_objs(std::move(o)) {}
 	ListObject(Type _type = LIST)
 		: Object(_type) {}
 	int size() const {
-		return (int)v.size();
+		switch (m_strategy) {
+		case INTS:
+			return (int)m_ints.size();
+		case FLOATS:
+			return (int)m_floats.size();
+		default:
+			return (int)m_objs.size();
+		}
 	}
-	void clear() override {
-		v.clear(); // vector clear
+	void clear() override; // vector clear
+	void traverse(const ObjVisitor &vis) override {
+		for (const auto &o : m_objs)
+			visitRef(vis, o);
+	}
+	size_t payloadSize() const override {
+		return m_objs.capacity() * sizeof(ObjRef) + m_ints.capacity() * sizeof(int64_t) + m_floats.capacity() * sizeof(double);
 	}
 
-	void append(const ObjRef &a) {
-		v.push_back(a);
+	// let the list store its elements unboxed. vm makes the objects for them when they are read.
+	// a list that has elements already is unboxed now if they are all of one kind. does nothing for a tuple
+	void allowUnboxed(PyVM *vm);
+	Strategy strategy() const {
+		return m_strategy;
 	}
-	void prepend(const ObjRef &a) {
-		v.insert(v.begin(), a);
+	// the unboxed elements, valid only for the matching strategy()
+	const std::vector<int64_t> &ints() const {
+		return m_ints;
 	}
-
-	ObjRef pop(int index) {
-		ObjRef ref = v.at(index);
-		v.erase(v.begin() + index);
-		return ref;
+	const std::vector<double> &floats() const {
+		return m_floats;
+	}
+	// the elements as objects. switches an unboxed list to the generic storage
+	std::vector<ObjRef> &objects() {
+		if (m_strategy != OBJECTS)
+			generalize();
+		return m_objs;
 	}
+	// element i, boxed if it needs to be
+	ObjRef at(int i) const;
 
-	std::vector<ObjRef> v;
+	// a growing list takes the slow path, which accounts the growth
+	void append(const ObjRef &a) {
+		if (m_strategy == OBJECTS && (m_vm == nullptr || !m_objs.empty()) && m_objs.size() < m_objs.capacity())
+			m_objs.push_back(a);
+		else
+			appendSlow(a);
+	}
+	void append(ObjRef &&a) {
+		if (m_strategy == OBJECTS && (m_vm == nullptr || !m_objs.empty()) && m_objs.size() < m_objs.capacity())
+			m_objs.push_back(std::move(a));
+		else
+			appendSlow(a);
+	}
+	void prepend(const ObjRef &a);
+	// append all the elements of o, which can be this list
+	void extend(const ListObject &o);
+	ObjRef pop(int index);
+
+	ObjRef getSubscr(const ObjRef &key, PyVM *vm) override;
+	void   setSubscr(const ObjRef &key, const ObjRef &value) override;
+	ObjRef iter(PyVM *_vm) override;
+
+private:
+	// switches an empty list to the strategy a would need. true if a goes to the unboxed storage
+	bool fitsUnboxed(const ObjRef &a);
+	void appendSlow(const ObjRef &a);
+	void generalize();
+
+	Strategy             m_strategy = OBJECTS;
+	PyVM                *m_vm       = nullptr; // set by allowUnboxed()
+	std::vector<ObjRef>  m_objs;
+	std::vector<int64_t> m_ints;
+	std::vector<double>  m_floats;
 };
 using ListObjRef = PoolPtr<ListObject>;
 
 struct TupleObject : public ListObject {
+	DEFINE_OBJECT_SIZE
 	TupleObject()
 		: ListObject(TUPLE) {}
 };
@@ -491,6 +652,7 @@ using TupleObjRef = PoolPtr<TupleObject>;
 
 template <typename T>
 struct MapKeyValueIterObject : public MapIterObject<T> {
+	DEFINE_OBJECT_SIZE
 	MapKeyValueIterObject(const PoolPtr<T> &l, PyVM *vm)
 		: MapIterObject<T>(l, vm) {}
 
@@ -531,6 +693,8 @@ struct PObjType<const std::string &> { using ot = StrObject; };
 template <>
 struct PObjType<const char *> { using ot = StrObject; };
 template <>
+struct PObjType<Name> { using ot = StrObject; };
+template <>
 struct PObjType<char> { using ot = StrObject; }; // single character -> string
 template <>
 struct PObjType<std::wstring> { using ot = UnicodeObject; };
@@ -568,6 +732,13 @@ struct Extract {
 		o->checkTypeT<T>();
 		return (T) static_cast<POBJ_TYPE(T) *>(o.get())->v;
 	}
+	// the value is moved out of an object that no one else references
+	T operator()(ObjRef &&o) {
+		if (o.use_count() != 1)
+			return (*this)(static_cast<const ObjRef &>(o));
+		o->checkTypeT<T>();
+		return (T)std::move(static_cast<POBJ_TYPE(T) *>(o.get())->v);
+	}
 };
 // some special cases are below
 template <>
@@ -582,12 +753,12 @@ template <>
 struct Extract<char> {
 	char operator()(const ObjRef &o) {
 		CHECK(!o.isNull(), "Extract from nullptr ref");
-		if (o->type == Object::STR) {
+		if (o->type() == Object::STR) {
 			auto *s = static_cast<StrObject *>(o.get());
 			CHECK(s->size() == 1, "string needs to be single character");
 			return s->v[0];
 		}
-		if (o->type == Object::INT) {
+		if (o->type() == Object::INT) {
 			auto *s = static_cast<IntObject *>(o.get());
 			return *(char *)&(s->v); // doesn't handle overflow
 		}
@@ -598,12 +769,12 @@ template <>
 struct Extract<wchar_t> {
 	wchar_t operator()(const ObjRef &o) {
 		CHECK(!o.isNull(), "Extract from nullptr ref");
-		if (o->type == Object::USTR) {
+		if (o->type() == Object::USTR) {
 			auto *s = static_cast<UnicodeObject *>(o.get());
 			CHECK(s->size() == 1, "ustring needs to be single character");
 			return s->v[0];
 		}
-		if (o->type == Object::INT) {
+		if (o->type() == Object::INT) {
 			auto *s = static_cast<IntObject *>(o.get());
 			return *(wchar_t *)&(s->v); // doesn't handle overflow
 		}
@@ -615,23 +786,68 @@ template <>
 struct Extract<double> {
 	double operator()(const ObjRef &o) {
 		CHECK(!o.isNull(), "Extract from nullptr ref");
-		if (o->type == Object::INT) {
+		if (o->type() == Object::INT) {
 			return (double)static_cast<IntObject *>(o.get())->v;
 		}
-		if (o->type == Object::FLOAT) {
+		if (o->type() == Object::FLOAT) {
 			return static_cast<FloatObject *>(o.get())->v;
 		}
 		THROW("Extract<double> unexpectyed type:" << o->typeName());
 	}
 };
+// the values of an unboxed list are copied without making objects for them. false if it takes the generic way
+template <typename ET>
+bool extractUnboxed(const ListObject *, std::vector<ET> *) {
+	return false;
+}
+inline bool extractUnboxed(const ListObject *lo, std::vector<int64_t> *v) {
+	if (lo->strategy() != ListObject::INTS)
+		return false;
+	*v = lo->ints();
+	return true;
+}
+inline bool extractUnboxed(const ListObject *lo, std::vector<int> *v) {
+	if (lo->strategy() != ListObject::INTS)
+		return false;
+	v->assign(lo->ints().begin(), lo->ints().end());
+	return true;
+}
+inline bool extractUnboxed(const ListObject *lo, std::vector<double> *v) {
+	if (lo->strategy() == ListObject::FLOATS)
+		*v = lo->floats();
+	else if (lo->strategy() == ListObject::INTS)
+		v->assign(lo->ints().begin(), lo->ints().end());
+	else
+		return false;
+	return true;
+}
+
 template <typename ET> // partial specialization for a uniform list of anything
 struct Extract<std::vector<ET>> {
 	std::vector<ET> operator()(const ObjRef &o) {
 		CHECK(!o.isNull(), "Extract from nullptr ref");
 		auto            lo = dynamic_pcast<ListObject>(o);
 		std::vector<ET> v;
-		for (auto it = lo->v.begin(); it != lo->v.end(); ++it) {
-			v.push_back(Extract<ET>()(*it));
+		if (extractUnboxed(lo.get(), &v))
+			return v;
+		v.reserve(lo->size());
+		for (int i = 0; i < lo->size(); ++i) {
+			v.push_back(Extract<ET>()(lo->at(i)));
+		}
+		return v;
+	}
+	// the items are moved out of a list that no one else references
+	std::vector<ET> operator()(ObjRef &&o) {
+		if (o.use_count() != 1)
+			return (*this)(static_cast<const ObjRef &>(o));
+		auto            lo = dynamic_pcast<ListObject>(o);
+		std::vector<ET> v;
+		if (extractUnboxed(lo.get(), &v))
+			return v;
+		auto &items = lo->objects();
+		v.reserve(items.size());
+		for (auto it = items.begin(); it != items.end(); ++it) {
+			v.push_back(Extract<ET>()(std::move(*it)));
 		}
 		return v;
 	}
@@ -648,10 +864,10 @@ inline const std::string *extractStrPtr(const ObjRef &o, StrModifier mod) {
 template <>
 inline const std::wstring *extractStrPtr(const ObjRef &o, StrModifier mod) {
 	CHECK(!o.isNull(), "Extract from nullptr ref");
-	if (o->type == Object::USTR) {
+	if (o->type() == Object::USTR) {
 		return static_cast<UnicodeObject *>(o.get())->getWStr(mod);
 	}
-	if (o->type == Object::STR) {
+	if (o->type() == Object::STR) {
 		return static_cast<StrObject *>(o.get())->getWStr(mod);
 	}
 	THROW("Extract<double> unexpectyed type:" << o->typeName());
@@ -664,6 +880,12 @@ struct Extract<std::wstring> {
 		return *extractStrPtr<wchar_t>(o, STRMOD_NONE);
 	}
 };
+template <>
+struct Extract<Name> {
+	Name operator()(const ObjRef &o) {
+		return Name(*extractStrPtr<char>(o, STRMOD_NONE));
+	}
+};
 
 template <typename T>
 struct Extract<const T &> { // convertor for const reference of something
@@ -676,6 +898,9 @@ struct Extract<ObjRef> {
 	ObjRef operator()(const ObjRef &o) {
 		return o;
 	}
+	ObjRef operator()(ObjRef &&o) {
+		return std::move(o);
+	}
 };
 
 // needs to be declared after extract()
@@ -687,69 +912,85 @@ void GenericSubscriptable<T, ElemT>::setSubscr(const ObjRef &key, const ObjRef &
 
 // --------------------------------------------------- complex types --------------------------------------------------
 
-int64_t hashNum(const ObjRef &argref);
-bool    objEquals(const ObjRef &lhsref, const ObjRef &rhsref, PyVM *vm);
-
-struct ObjEquals {
-	PyVM *vm;
-	bool  operator()(const ObjRef &lhsref, const ObjRef &rhsref) const {
-        return objEquals(lhsref, rhsref, vm);
-	}
-};
+bool objEquals(const ObjRef &lhsref, const ObjRef &rhsref, PyVM *vm);
 
-// WARNNING!!!!!!!!!!!!!!!!!!!!! not a complete implementation, does not handle collisions
 struct DictObject : public Object, public ISubscriptable, public MapIterable<DictObject> {
-	// vm is needed for the compare which needs it in order to create unicode objects if the need of conversion arises
+	DEFINE_OBJECT_SIZE
 	DictObject(PyVM *vm)
-		: Object(DICT), v(4, hashNum, ObjEquals{vm}) {}
+		: Object(DICT), v(vm, this) {}
 
 	void clear() override {
 		v.clear(); // map clear
 	}
+	void traverse(const ObjVisitor &vis) override {
+		for (const auto &it : v) {
+			visitRef(vis, it.first);
+			visitRef(vis, it.second);
+		}
+	}
+	size_t payloadSize() const override {
+		return v.payloadSize();
+	}
 
 	void setSubscr(const ObjRef &key, const ObjRef &value) override {
 		v[key] = value;
 	}
 
 	ObjRef getSubscr(const ObjRef &key, PyVM *) override {
-		return v[key];
+		auto it = v.find(key);
+		CHECK(it != v.end(), "KeyError: key not found in dict");
+		return it->second;
 	}
 
 	virtual ObjRef pop(const ObjRef &key) {
-		ObjRef ref = v[key];
+		auto it = v.find(key);
+		if (it == v.end())
+			return ObjRef();
+		ObjRef ref = it->second;
 		v.erase(key);
 		return ref;
 	}
 
-	std::unordered_map<ObjRef, ObjRef, decltype(hashNum) *, ObjEquals> v;
+	ObjDict v;
 };
 
 using DictObjRef = PoolPtr<DictObject>;
 
 struct StrDictObject : public Object, public ISubscriptable, public MapIterable<StrDictObject> {
+	DEFINE_OBJECT_SIZE
 	StrDictObject(const NameDict &nd)
-		: Object(STRDICT), v(nd) {}
+		: Object(STRDICT), v(nd, this) {}
 	StrDictObject()
-		: Object(STRDICT) {}
+		: Object(STRDICT), v(this) {}
 
 	void clear() override {
 		v.clear(); // map clear
 	}
+	void traverse(const ObjVisitor &vis) override {
+		traverseNameDict(v, vis);
+	}
+	size_t payloadSize() const override {
+		return v.payloadSize();
+	}
 
+	// only a store interns the key, a lookup of a string that was never interned can't find anything
 	void setSubscr(const ObjRef &key, const ObjRef &value) override {
 		const std::string &sk = checked_cast<StrObject>(key)->v;
-		v[sk]                 = value;
+		v[Name(sk)]           = value;
 	}
 
 	ObjRef getSubscr(const ObjRef &key, PyVM *) override {
-		const std::string &sk = checked_cast<StrObject>(key)->v;
-		return v[sk];
+		auto it = v.find(checked_cast<StrObject>(key)->v);
+		CHECK(it != v.end(), "KeyError: key not found in dict");
+		return it->second;
 	}
 
 	virtual ObjRef pop(const ObjRef &key) {
-		std::string strKey = Extract<std::string>()(key);
-		ObjRef      ref    = v[strKey];
-		v.erase(strKey);
+		auto it = v.find(Extract<std::string>()(key));
+		if (it == v.end())
+			return ObjRef();
+		ObjRef ref = it->second;
+		v.erase(Name(it->first)); // a copy, erase clears the name in the entry
 		return ref;
 	}
 
@@ -761,7 +1002,7 @@ using StrDictObjRef = PoolPtr<StrDictObject>;
 template <typename F>
 void forNameDict(const NameDict &dict, Object::Type t, F func) {
 	for (auto it = dict.begin(); it != dict.end(); ++it) {
-		if (it->second->type == t) {
+		if (it->second->type() == t) {
 			func(it->first, it->second);
 		}
 	}
@@ -771,7 +1012,7 @@ void forNameDict(const NameDict &dict, Object::Type t, F func) {
 template <typename C, typename F>
 void forNameDict(const NameDict &dict, F func) {
 	for (auto it = dict.begin(); it != dict.end(); ++it) {
-		if (it->second->type == Object::typeValue<C>()) {
+		if (it->second->type() == Object::typeValue<C>()) {
 			auto c = static_pcast<C>(it->second);
 			func(it->first, c);
 		}
@@ -780,12 +1021,21 @@ void forNameDict(const NameDict &dict, F func) {
 
 class CodeObject : public Object {
 public:
+	DEFINE_OBJECT_SIZE
 	CodeObject()
 		: Object(CODE) {}
 	CodeObject(const CodeDefinition &co)
 		: Object(CODE), m_co(co) {}
+	// constants can't create a reference cycle so there is no clear()
+	void traverse(const ObjVisitor &v) override {
+		for (const auto &o : m_co.co_consts)
+			visitRef(v, o);
+	}
 	int            lineFromIndex(int i) const;
 	CodeDefinition m_co;
+	// per co_code offset, the LOAD_ATTR instructions whose result is only ever called by the CALL_FUNCTION
+	// that follows. computed when the code is validated, see markCallTemps() in instruction.cpp
+	std::vector<bool> m_callTemps;
 };
 
 // values of co_flags. copied from python code.h
@@ -799,14 +1049,18 @@ class ModuleObject;
 using ModuleObjRef = PoolPtr<ModuleObject>;
 
 struct CallableObject : public Object {
-	CallableObject(Type _type, ModuleObjRef mod, uint propType = 0)
-		: Object(_type, ICALLABLE | propType), m_module(mod), m_isStaticMethod(false) {}
+	DEFINE_OBJECT_SIZE
+	CallableObject(Type _type, ModuleObjRef mod)
+		: Object(_type), m_module(mod), m_isStaticMethod(false) {}
 	// from - the calling frame
 	// frame - this call frame
 
 	void clear() override {
 		m_module.reset();
 	}
+	void traverse(const ObjVisitor &v) override {
+		visitRef(v, m_module);
+	}
 
 	ModuleObjRef m_module; // module this object is defined in, for globals. may be nullptr if not relevant
 	bool         m_isStaticMethod;
@@ -815,6 +1069,7 @@ struct CallableObject : public Object {
 using CallableObjRef = PoolPtr<CallableObject>;
 
 struct FuncObject : public CallableObject {
+	DEFINE_OBJECT_SIZE
 	FuncObject(const CodeObjRef &cobj, ModuleObjRef module)
 		: CallableObject(FUNC, module), m_code(cobj) {}
 
@@ -822,6 +1077,10 @@ struct FuncObject : public CallableObject {
 		CallableObject::clear();
 		m_code.reset();
 	}
+	void traverse(const ObjVisitor &v) override {
+		CallableObject::traverse(v);
+		visitRef(v, m_code);
+	}
 
 	ObjRef      call(Frame &from, Frame &frame, int posCount, int kwCount, const ObjRef &self) override;
 
@@ -836,6 +1095,7 @@ using FuncObjRef = PoolPtr<FuncObject>;
 
 // wrap a c function
 struct ICWrap : public Object {
+	DEFINE_OBJECT_SIZE
 	ICWrap()
 		: Object(CFUNC_WRAP) {}
 	virtual int                argsCount()                      = 0;
@@ -847,6 +1107,7 @@ struct ICWrap : public Object {
 using ICWrapPtr = PoolPtr<ICWrap>;
 
 struct CFuncObject : public CallableObject {
+	DEFINE_OBJECT_SIZE
 	CFuncObject(const ICWrapPtr &cwrap)
 		: CallableObject(FUNC, ModuleObjRef()), wrap(cwrap) {}
 	ObjRef      call(Frame &from, Frame &frame, int posCount, int kwCount, const ObjRef &self) override;
@@ -857,6 +1118,10 @@ struct CFuncObject : public CallableObject {
 		CallableObject::clear();
 		wrap.reset();
 	}
+	void traverse(const ObjVisitor &v) override {
+		CallableObject::traverse(v);
+		visitRef(v, wrap);
+	}
 	ICWrapPtr wrap;
 };
 
@@ -864,12 +1129,16 @@ struct ICtorWrap;
 
 // wrapper for a C instance of a class
 struct ICInstWrap : public Object {
+	DEFINE_OBJECT_SIZE
 	ICInstWrap()
 		: Object(CINSTANCE_WRAP) {}
 
 	void clear() override {
 		m_ctor.reset();
 	}
+	void traverse(const ObjVisitor &v) override {
+		visitRef(v, m_ctor);
+	}
 
 	~ICInstWrap() override = default;
 
@@ -877,6 +1146,7 @@ struct ICInstWrap : public Object {
 };
 template <typename T>
 struct CInstWrap : public ICInstWrap {
+	DEFINE_OBJECT_SIZE
 	virtual T *ptr() = 0;
 
 	~CInstWrap() override = default;
@@ -884,6 +1154,7 @@ struct CInstWrap : public ICInstWrap {
 // for pointer value given by the C user
 template <typename T>
 struct CInstWrapPtr : public CInstWrap<T> {
+	DEFINE_OBJECT_SIZE
 	CInstWrapPtr(T *_v = nullptr)
 		: v(_v) {}
 
@@ -893,6 +1164,7 @@ struct CInstWrapPtr : public CInstWrap<T> {
 // for by-value value given by the user
 template <typename T, typename U> // store type T, return pointer of type U (a base type of U)
 struct CInstWrapValue : public CInstWrap<U> {
+	DEFINE_OBJECT_SIZE
 
 	CInstWrapValue(const T &_v)
 		: v(_v) {}
@@ -903,6 +1175,7 @@ struct CInstWrapValue : public CInstWrap<U> {
 
 template <typename T>
 struct CInstWrapSharedPtr : public CInstWrap<T> {
+	DEFINE_OBJECT_SIZE
 	CInstWrapSharedPtr(std::shared_ptr<T> _v = nullptr)
 		: v(_v) {}
 
@@ -925,12 +1198,14 @@ struct CtorDef {
 };
 
 struct ICtorWrap : public Object {
+	DEFINE_OBJECT_SIZE
 	ICtorWrap()
 		: Object(CCTOR_WRAP) {}
 	virtual PoolPtr<ICInstWrap> construct(PyVM *vm, CallArgs &args) = 0;
 };
 template <typename C, typename A1>
 struct CtorWrap : public ICtorWrap {
+	DEFINE_OBJECT_SIZE
 	PoolPtr<ICInstWrap> construct(PyVM *vm, CallArgs &args) override {
 		A1 a1 = Extract<A1>()(args[0]);
 		return vm->alloct<ICInstWrap>(new CInstWrapSharedPtr<C>(std::make_shared<C>(vm, a1)));
@@ -939,6 +1214,7 @@ struct CtorWrap : public ICtorWrap {
 
 template <typename C> // partial specialization
 struct CtorWrap<C, NoType> : public ICtorWrap {
+	DEFINE_OBJECT_SIZE
 	PoolPtr<ICInstWrap> construct(PyVM *vm, CallArgs &args) override {
 		return vm->alloct<ICInstWrap>(new CInstWrapSharedPtr<C>(std::make_shared<C>(vm)));
 	}
@@ -952,6 +1228,7 @@ using InstanceObjRef = PoolPtr<InstanceObject>;
 // represents a bound method
 class MethodObject : public CallableObject {
 public:
+	DEFINE_OBJECT_SIZE
 	MethodObject(const CallableObjRef &func, const InstanceObjRef &self)
 		: CallableObject(METHOD, func->m_module), m_self(self), m_func(func) {}
 
@@ -960,6 +1237,11 @@ public:
 		m_self.reset();
 		m_func.reset();
 	}
+	void traverse(const ObjVisitor &v) override {
+		CallableObject::traverse(v);
+		visitRef(v, m_self);
+		visitRef(v, m_func);
+	}
 	ObjRef      call(Frame &from, Frame &frame, int posCount, int kwCount, const ObjRef &self) override;
 	std::string funcname() const override ;
 
@@ -972,15 +1254,16 @@ public:
 
 using MethodObjRef = PoolPtr<MethodObject>;
 
-class ClassObject : public CallableObject //, public IAttrable
+class ClassObject : public CallableObject
 {
 public:
+	DEFINE_OBJECT_SIZE
 	ClassObject(const std::string &name, ModuleObjRef module, PyVM *vm)
-		: CallableObject(CLASS, module, IATTRABLE), m_name(name), m_vm(vm) {}
+		: CallableObject(CLASS, module), m_name(name), m_vm(vm) {}
 	// called from instruction BUILD_CLASS
 	// called from create wrapper class for a C++ class
 	ClassObject(const StrDictObjRef &methods, const std::vector<ObjRef> &bases, const std::string &name, ModuleObjRef module, PyVM *vm)
-		: CallableObject(CLASS, module, IATTRABLE), m_dict(methods), m_name(name), m_vm(vm) {
+		: CallableObject(CLASS, module), m_dict(methods), m_name(name), m_vm(vm) {
 		CHECK(bases.size() <= 1, "more that one base class not supported");
 		if (bases.size() > 0)
 			m_base = checked_cast<ClassObject>(bases[0]);
@@ -992,6 +1275,12 @@ public:
 		m_base.reset();
 		m_cwrap.reset();
 	}
+	void traverse(const ObjVisitor &v) override {
+		CallableObject::traverse(v);
+		visitRef(v, m_dict);
+		visitRef(v, m_base);
+		visitRef(v, m_cwrap);
+	}
 
 	// void makeMethods(const InstanceObjRef& i);
 	ObjRef      call(Frame &from, Frame &frame, int posCount, int kwCount, const ObjRef &self) override;
@@ -1000,7 +1289,7 @@ public:
 	}
 
 	ObjRef addMember(const ObjRef &o, const std::string &name) {
-		m_dict->v[name] = o;
+		m_dict->v[Name(name)] = o;
 		return o;
 	}
 
@@ -1012,8 +1301,8 @@ public:
 		return addMember(m_vm->alloc(new MethodObject(calb, InstanceObjRef())), name);
 	}
 
-	ObjRef attr(const std::string &name) override;
-	void   setattr(const std::string &name, const ObjRef &o) override {
+	ObjRef attr(const Name &name) override;
+	void   setattr(const Name &name, const ObjRef &o) override {
         m_dict->v[name] = o;
 	}
 
@@ -1044,21 +1333,29 @@ public:
 	std::string          m_name;
 	PyVM *               m_vm;
 	PoolPtr<ICInstWrap>  m_cwrap; // if it's a wrapper for a C++ object this will not be nullptr
+	Shape                m_rootShape; // the shape of instances that have no attributes yet
 };
 
 using ClassObjRef = PoolPtr<ClassObject>;
 
-class ModuleObject : public Object //, public IAttrable
+class ModuleObject : public Object
 {
 public:
+	DEFINE_OBJECT_SIZE
 	ModuleObject(const std::string &name, PyVM *vm)
-		: Object(MODULE, IATTRABLE), m_name(name), m_vm(vm) {}
+		: Object(MODULE), m_name(name), m_globals(this), m_vm(vm) {}
 	void clear() override {
 		m_globals.clear(); // map clear
 	}
+	void traverse(const ObjVisitor &v) override {
+		traverseNameDict(m_globals, v);
+	}
+	size_t payloadSize() const override {
+		return m_globals.payloadSize();
+	}
 
 	ObjRef addGlobal(const ObjRef &o, const std::string &name) {
-		m_globals[name] = o;
+		m_globals[Name(name)] = o;
 		return o;
 	}
 	ObjRef getGlobal(const std::string &name) {
@@ -1068,12 +1365,12 @@ public:
 		m_globals.erase(name);
 	}
 
-	ObjRef attr(const std::string &name) override {
+	ObjRef attr(const Name &name) override {
 		return tryLookup(m_globals, name);
 	}
 
-	void setattr(const std::string &name, const ObjRef &o) override {
-		m_globals[name] = o;
+	void setattr(const Name &name, const ObjRef &o) override {
+		m_globals[Name(name)] = o;
 	}
 
 	ObjRef defIc(const std::string &name, const ICWrapPtr &ic);
@@ -1109,28 +1406,63 @@ public:
 	PyVM *      m_vm; // needed for implementation of shortcuts of object creations.
 };
 
-class InstanceObject : public Object //, public IAttrable
+class InstanceObject : public Object
 {
 public:
+	DEFINE_OBJECT_SIZE
 	InstanceObject(const ClassObjRef &cls)
-		: Object(INSTANCE, IATTRABLE), m_class(cls) {}
+		: Object(INSTANCE), m_class(cls), m_shape(cls.isNull() ? nullptr : &cls->m_rootShape) {}
 	void clear() override {
+		// the shape belongs to the class so it can't be used after the class reference is gone
+		m_shape = nullptr;
+		m_slots.clear();
+		m_dict.reset();
 		m_class.reset();
-		m_dict.clear(); // map clear
 		m_cwrap.reset();
 	}
+	void traverse(const ObjVisitor &v) override {
+		visitRef(v, m_class);
+		for (const auto &s : m_slots)
+			visitRef(v, s);
+		if (m_dict)
+			traverseNameDict(*m_dict, v);
+		visitRef(v, m_cwrap);
+	}
+	size_t payloadSize() const override {
+		return m_slots.heapSize() + (m_dict ? sizeof(NameDict) + m_dict->payloadSize() : 0);
+	}
 
 	~InstanceObject() override = default;
 
-	ObjRef attr(const std::string &name) override;
-	void   setattr(const std::string &name, const ObjRef &o) override {
-        m_dict[name] = o;
-	}
+	ObjRef attr(const Name &name) override;
+	void   setattr(const Name &name, const ObjRef &o) override;
+	// the attribute from __getattr__ of the class, nullptr ref if there is none or it raised AttributeError.
+	// takes a string so that a name which was never interned can still be asked for
+	ObjRef getattrHook(const std::string &name);
 	// attr without __getattr__ support
-	ObjRef simple_attr(const std::string &name);
+	// a bound method is made in the MethodObject *reuse instead of in a new object if nothing else references it.
+	// otherwise *reuse is set to the new bound method
+	ObjRef simple_attr(const Name &name, ObjRef *reuse = nullptr);
+	// an attribute assigned to the instance itself, nullptr ref if there isn't one
+	ObjRef ownAttr(const Name &name) const;
+
+	template <typename F> // F(const Name&, const ObjRef&)
+	void forEachOwnAttr(F f) const {
+		if (m_dict) {
+			for (const auto &it : *m_dict)
+				f(it.first, it.second);
+			return;
+		}
+		for (int i = 0; i < m_slots.size(); ++i)
+			f(m_shape->nameAt(i), m_slots[i]);
+	}
 
 	ClassObjRef m_class;
-	NameDict    m_dict;
+	// attributes are the values in m_slots, named by m_shape, which is shared with other instances of the class.
+	// when the class shape tree is full m_shape is nullptr and the attributes are in m_dict instead
+	Shape                    *m_shape;
+	VarArray<ObjRef, 4>       m_slots;
+	std::unique_ptr<NameDict> m_dict;
 
 	/// if it wraps a C++ instance this will not be nullptr
 	/// assigned in ClassObject::instancePtr or in the class call (with the ctor wrapper)
@@ -1193,6 +1525,7 @@ InstanceObjRef ClassObject::instanceValue(const T &v) {
 // wrapper that contains methods of primitive objects like string
 class PrimitiveAttrAdapter : public CallableObject {
 public:
+	DEFINE_OBJECT_SIZE
 	PrimitiveAttrAdapter(ObjRef obj, const std::string &name, PyVM *vm)
 		: CallableObject(PRIMITIVE_ADAPTER, ModuleObjRef()), m_obj(obj), m_name(name), m_vm(vm) {}
 
@@ -1200,6 +1533,10 @@ public:
 		CallableObject::clear();
 		m_obj.reset();
 	}
+	void traverse(const ObjVisitor &v) override {
+		CallableObject::traverse(v);
+		visitRef(v, m_obj);
+	}
 
 	ObjRef      call(Frame &from, Frame &frame, int posCount, int kwCount, const ObjRef &self) override;
 	std::string funcname() const override {
@@ -1236,8 +1573,9 @@ private:
 
 class Builtins : public ModuleObject {
 public:
+	DEFINE_OBJECT_SIZE
 	Builtins(PyVM *vm);
-	ObjRef get(const std::string &name);
+	ObjRef get(const Name &name);
 	void   add(const std::string &name, const ObjRef &v);
 
 private:
@@ -1246,8 +1584,9 @@ private:
 
 class GeneratorObject : public CallableObject, public IIterator, public IIterable {
 public:
+	DEFINE_OBJECT_SIZE
 	GeneratorObject(const CodeObjRef &cobj, ModuleObjRef module, PyVM *vm)
-		: CallableObject(GENERATOR, module), m_f(vm, module, &m_locals), m_atStart(true)
+		: CallableObject(GENERATOR, module), m_locals(this), m_f(vm, module, &m_locals), m_atStart(true)
 	// Object is not copyable so this initialization of m_f with the address of a member is ok
 	{
 		m_f.setCode(cobj);
@@ -1281,6 +1620,14 @@ public:
 		m_locals.clear(); // map clear
 		m_f.clear();      // Frame clear calls resets or vector clear
 	}
+	void traverse(const ObjVisitor &v) override {
+		CallableObject::traverse(v);
+		traverseNameDict(m_locals, v);
+		m_f.traverse(v);
+	}
+	size_t payloadSize() const override {
+		return m_locals.payloadSize();
+	}
 
 private:
 	NameDict m_locals;
@@ -1290,6 +1637,7 @@ private:
 
 class XRange : public Object, public IIterator, public IIterable {
 public:
+	DEFINE_OBJECT_SIZE
 	XRange(int begin, int end, int step, PyVM *vm)
 		: Object(XRANGE), m_begin(begin), m_end(end), m_step(step), m_next(begin), m_vm(vm) {}
 
@@ -1319,7 +1667,7 @@ private:
 
 template <typename T>
 ObjRef PyVM::makeFromT(T v) {
-	return alloc(new POBJ_TYPE(T)(v));
+	return alloc(new POBJ_TYPE(T)(std::forward<T>(v))); // moves only if T is not a reference
 }
 
 template <>
@@ -1351,3 +1699,8 @@ template <typename T>
 T extract(const ObjRef &r) {
 	return Extract<T>()(r);
 }
+// may move the value out of the object if r is the only reference to it
+template <typename T>
+T extract(ObjRef &&r) {
+	return Extract<T>()(std::move(r));
+}
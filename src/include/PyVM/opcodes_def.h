@@ -10,11 +10,13 @@
 // limitations under the License.
 
 #define name_op def_op
-#define jrel_op def_op
-#define jabs_op def_op
+#define jrel_op(name, num, flags) def_op(name, num, (flags) | JREL)
+#define jabs_op(name, num, flags) def_op(name, num, (flags) | JABS)
 #define _def_const def_op
 
 #define IMPL 1
+#define JREL 2 // the argument is a jump distance from the next instruction
+#define JABS 4 // the argument is a jump target
 
 
 def_op(STOP_CODE, 0, 0)
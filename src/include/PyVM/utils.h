@@ -13,6 +13,7 @@
 
 #include "defs.h"
 #include <algorithm>
+#include <memory>
 #include <string>
 
 bool         wstrFromUtf8(const std::string &s, std::wstring *out);
@@ -21,6 +22,15 @@ std::string  ansiFromwstr(const std::wstring &s);
 std::string utf8FromWstr(const std::wstring &s);
 std::string extractFileNameWithoutExtension(const std::string &s);
 
+// read only bytes that someone else keeps. owner keeps them alive when they are not kept by the caller, see mapFile()
+struct ByteSpan {
+	const char           *data = nullptr;
+	size_t                size = 0;
+	std::shared_ptr<void> owner;
+};
+// the file at path mapped to memory, unmapped when the last copy of the span is gone. null data if it can't be opened
+ByteSpan mapFile(const std::string &path);
+
 uint64_t msecTime();
 void     debugBreak();
 void     MessageBoxCall();
@@ -30,6 +40,26 @@ void     MessageBoxCall();
 #define CONSOLE_GRAY 8
 void consoleSetColor(int col);
 
+// three-way compare of an ansi and a wide string as if a went through wstrFromAnsi() first, without converting it
+inline int compareAnsiWstr(const std::string &a, const std::wstring &w) {
+	size_t n = std::min(a.size(), w.size());
+	for (size_t i = 0; i < n; ++i) {
+		wchar_t c = (wchar_t)a[i];
+		if (c != w[i])
+			return c < w[i] ? -1 : 1;
+	}
+	return a.size() < w.size() ? -1 : (a.size() > w.size() ? 1 : 0);
+}
+
+// position of needle in hay where one of them is ansi and the other wide, compared as in compareAnsiWstr()
+template <typename ChH, typename ChN>
+size_t findMixed(const std::basic_string<ChH> &hay, const std::basic_string<ChN> &needle) {
+	auto it = std::search(hay.begin(), hay.end(), needle.begin(), needle.end(), [](ChH h, ChN n) {
+		return (wchar_t)h == (wchar_t)n;
+	});
+	return it == hay.end() && !needle.empty() ? std::basic_string<ChH>::npos : (size_t)(it - hay.begin());
+}
+
 template <typename Ch>
 std::basic_string<Ch> toLower(const std::basic_string<Ch> &s) {
 	std::basic_string<Ch> c(s);
@@ -39,28 +69,54 @@ std::basic_string<Ch> toLower(const std::basic_string<Ch> &s) {
 	return c;
 }
 
+// the range [*first, *end) of str that is left after trimming, without copying anything
+template <typename Ch, typename F>
+void trimBounds(const std::basic_string<Ch> &str, const F &pred, size_t *first, size_t *end) {
+	size_t b = 0, e = str.length();
+	while (b < e && pred(str[b]))
+		++b;
+	while (e > b && pred(str[e - 1]))
+		--e;
+	*first = b;
+	*end   = e;
+}
+
 template <typename Ch, typename F>
 void trim(std::basic_string<Ch> &str, const F &pred) {
-	size_t first = 0;
-	size_t len   = str.length();
-	if (len == 0)
-		return;
-	while (first < len && pred(str[first]))
-		++first;
-	if (first == len) {
-		str = std::basic_string<Ch>();
-		return;
+	size_t first, end;
+	trimBounds(str, pred, &first, &end);
+	if (first != 0 || end != str.length())
+		str = str.substr(first, end - first);
+}
+
+// the form paths are compared in: '/' separators that are never repeated.
+// on windows '\\' is a separator too and case is ignored
+template <typename Ch>
+std::basic_string<Ch> pathNormalized(const std::basic_string<Ch> &s) {
+	std::basic_string<Ch> r;
+	r.reserve(s.size());
+	for (Ch c : s) {
+#ifdef WIN32
+		if (c == '\\')
+			c = '/';
+		else
+			c = (Ch)std::tolower(c);
+#endif
+		if (c == '/' && !r.empty() && r.back() == '/')
+			continue;
+		r.push_back(c);
 	}
-	auto last = (int)len - 1;
-	while (last >= 0 && pred(str[last]))
-		--last;
-	if (first != 0 || last != str.length() - 1)
-		str = str.substr(first, last - first + 1);
+	return r;
+}
+
+template <typename Ch>
+bool isTrimSpace(Ch c) {
+	return c == ' ' || c == '\t' || c == '\n';
 }
 
 template <typename Ch>
 void trimSpaces(std::basic_string<Ch> &str) {
-	trim(str, [](Ch c) -> bool { return c == ' ' || c == '\t' || c == '\n'; });
+	trim(str, isTrimSpace<Ch>);
 }
 
 template <typename Ch>
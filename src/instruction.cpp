@@ -11,12 +11,14 @@
 
 #include "PyVM/OpImp.h"
 #include "PyVM/PyVM.h"
+#include "PyVM/StrKernels.h"
 #include "PyVM/defs.h"
 #include "PyVM/log.h"
 #include "PyVM/objects.h"
 #include "PyVM/opcodes.h"
 #include "PyVM/utils.h"
 
+#include <algorithm>
 #include <cmath>
 #include <sstream>
 
@@ -36,11 +38,13 @@ public:
 
 template <typename LT> // ListObject or TupleObject
 ObjRef OpImp::makeListFromStack(Frame &frame, int count) {
-	auto ret = vm->alloct<LT>(new LT());
-	ret->v.resize(count);
+	auto *ret   = new LT(); // filled before it is allocated so its payload is accounted
+	auto &items = ret->objects();
+	items.resize(count);
 	for (int i = count - 1; i >= 0; --i)
-		ret->v[i] = frame.m_stack.pop();
-	return ObjRef(ret);
+		items[i] = frame.m_stack.pop();
+	ret->allowUnboxed(vm);
+	return vm->alloc(ret);
 }
 
 template <typename OT>
@@ -73,32 +77,74 @@ static bool compareStrType(Object *lhs, Object *rhs, int op) {
 	return compareType<OT>(lhs, rhs, op);
 }
 
+// str against unicode, compared in place as if the str was converted to unicode.
+// swapped means the unicode string is the left hand side
+static bool compareMixedStr(const std::string &a, const std::wstring &w, int op, bool swapped) {
+	if (op == OPER_IN || op == OPER_NOT_IN) {
+		size_t pos = swapped ? findMixed(a, w) : findMixed(w, a);
+		return (pos != std::string::npos) ^ (op == OPER_NOT_IN);
+	}
+	int c = compareAnsiWstr(a, w);
+	if (swapped)
+		c = -c;
+	switch (op) {
+	case OPER_LESS:
+		return c < 0;
+	case OPER_LESS_EQ:
+		return c <= 0;
+	case OPER_EQ:
+		return c == 0;
+	case OPER_NOT_EQ:
+		return c != 0;
+	case OPER_GREATER:
+		return c > 0;
+	case OPER_GREATER_EQ:
+		return c >= 0;
+	default:
+		THROW("Unknown op " << op);
+	}
+}
+
 static bool operIs(const Object *lhsref, const Object *rhsref) {
-	if (lhsref->type == Object::NONE && rhsref->type == Object::NONE)
+	if (lhsref->type() == Object::NONE && rhsref->type() == Object::NONE)
 		return true;
 	// CPython also has int(x) == int(x) for x<=256, not implemented here
 	return lhsref == rhsref;
 }
 
 bool OpImp::operIn(const ObjRef &lhs, const ObjRef &rhs, bool isPositive) {
-	switch (rhs->type) {
+	switch (rhs->type()) {
 	case Object::TUPLE:
 	case Object::LIST: {
 		auto *l = checked_dynamic_pcast<ListObject>(rhs.get());
-		for (auto it = l->v.begin(); it != l->v.end(); ++it) {
-			if (compare(lhs, *it, OPER_EQ))
+		if (l->strategy() == ListObject::INTS && lhs->type() == Object::INT) {
+			const auto &v = l->ints();
+			return (findInt64(v.data(), v.size(), static_cast<IntObject *>(lhs.get())->v) != v.size()) == isPositive;
+		}
+		if (l->strategy() == ListObject::FLOATS && (lhs->type() == Object::FLOAT || lhs->type() == Object::INT)) {
+			// an int compares to a float as a float, see compare()
+			double      x = lhs->type() == Object::FLOAT ? static_cast<FloatObject *>(lhs.get())->v : (float)static_cast<IntObject *>(lhs.get())->v;
+			const auto &v = l->floats();
+			return (std::find(v.begin(), v.end(), x) != v.end()) == isPositive;
+		}
+		for (int i = 0; i < l->size(); ++i) {
+			if (compare(lhs, l->at(i), OPER_EQ))
 				return isPositive; // found
 		}
 		return !isPositive;
 	}
 	case Object::STRDICT: {
 		auto *d = checked_dynamic_pcast<StrDictObject>(rhs.get());
-		if (lhs->type != Object::STR)
+		if (lhs->type() != Object::STR)
 			return !isPositive;
 		const std::string &key = checked_dynamic_pcast<StrObject>(lhs)->v;
 		auto               it  = d->v.find(key);
 		return (it != d->v.end()) == isPositive;
 	}
+	case Object::DICT: {
+		auto *d = checked_dynamic_pcast<DictObject>(rhs.get());
+		return (d->v.find(lhs) != d->v.end()) == isPositive;
+	}
 	}
 	THROW("Can't do operator in for given objects " << lhs->typeName() << " " << rhs->typeName());
 }
@@ -110,8 +156,12 @@ bool OpImp::compareList(const ListObject *lhs, const ListObject *rhs, int op) {
 		THROW("Can't compare lists with " << op);
 	if (lhs->size() != rhs->size())
 		return op != OPER_EQ;
+	if (lhs->strategy() == ListObject::INTS && rhs->strategy() == ListObject::INTS)
+		return (lhs->ints() == rhs->ints()) == (op == OPER_EQ);
+	if (lhs->strategy() == ListObject::FLOATS && rhs->strategy() == ListObject::FLOATS)
+		return (lhs->floats() == rhs->floats()) == (op == OPER_EQ);
 	for (int i = 0; i < lhs->size(); ++i) {
-		if (!compare(lhs->v[i], rhs->v[i], OPER_EQ))
+		if (!compare(lhs->at(i), rhs->at(i), OPER_EQ))
 			return op != OPER_EQ;
 	}
 	return op == OPER_EQ;
@@ -122,9 +172,8 @@ static bool opHasEq(int op) {
 }
 
 static void checkNoCmp(const ObjRef &o) {
-	IAttrable *ao = o->tryAs<IAttrable>();
-	if (ao != nullptr)
-		CHECK(ao->attr("__nocmp__").isNull(), "An object of this type should not be compared (forgot to call '.get()'?");
+	if (o->hasProp(Object::IATTRABLE))
+		CHECK(o->attr("__nocmp__").isNull(), "An object of this type should not be compared (forgot to call '.get()'?");
 }
 
 // OpImp needed for creating temp conversion strings
@@ -139,14 +188,14 @@ bool OpImp::compare(const ObjRef &lhsref, const ObjRef &rhsref, int op) {
 		return !operIs(lhs, rhs);
 	}
 
-	if ((lhs->type == Object::NONE || rhs->type == Object::NONE) && op != OPER_IN && op != OPER_NOT_IN) {
-		if (lhs->type == Object::NONE && rhs->type == Object::NONE)
+	if ((lhs->type() == Object::NONE || rhs->type() == Object::NONE) && op != OPER_IN && op != OPER_NOT_IN) {
+		if (lhs->type() == Object::NONE && rhs->type() == Object::NONE)
 			return opHasEq(op);
 		return !opHasEq(op); // None is equal only to None
 	}
 
-	if (lhs->type == rhs->type) {
-		switch (lhs->type) {
+	if (lhs->type() == rhs->type()) {
+		switch (lhs->type()) {
 		case Object::INT:
 			return compareType<IntObject>(lhs, rhs, op);
 		case Object::BOOL:
@@ -167,19 +216,15 @@ bool OpImp::compare(const ObjRef &lhsref, const ObjRef &rhsref, int op) {
 			return (lhs == rhs) == opHasEq(op); // for all other types, reference compare
 		}
 	}
-	if (lhs->type == Object::USTR && rhs->type == Object::STR) {
-		ObjRef urhs = UnicodeObject::fromStr(rhsref, vm);
-		return compareStrType<UnicodeObject>(lhs, urhs.get(), op);
-	}
-	if (lhs->type == Object::STR && rhs->type == Object::USTR) {
-		ObjRef ulhs = UnicodeObject::fromStr(lhsref, vm);
-		return compareStrType<UnicodeObject>(ulhs.get(), rhs, op);
-	}
-	if ((lhs->type == Object::FLOAT && rhs->type == Object::INT)) {
+	if (lhs->type() == Object::USTR && rhs->type() == Object::STR)
+		return compareMixedStr(static_cast<StrObject *>(rhs)->v, static_cast<UnicodeObject *>(lhs)->v, op, true);
+	if (lhs->type() == Object::STR && rhs->type() == Object::USTR)
+		return compareMixedStr(static_cast<StrObject *>(lhs)->v, static_cast<UnicodeObject *>(rhs)->v, op, false);
+	if ((lhs->type() == Object::FLOAT && rhs->type() == Object::INT)) {
 		FloatObject floatRhs((float)((IntObject *)rhs)->v);
 		return compareType<FloatObject>(lhs, &floatRhs, op);
 	}
-	if ((lhs->type == Object::INT && rhs->type == Object::FLOAT)) {
+	if ((lhs->type() == Object::INT && rhs->type() == Object::FLOAT)) {
 		FloatObject floatLhs((float)((IntObject *)lhs)->v);
 		return compareType<FloatObject>(&floatLhs, rhs, op);
 	}
@@ -198,10 +243,31 @@ bool objEquals(const ObjRef &lhsref, const ObjRef &rhsref, PyVM *vm) {
 	return oi.compare(lhsref, rhsref, OPER_EQ);
 }
 
+bool dictKeyEquals(const ObjRef &a, const ObjRef &b, PyVM *vm) {
+	if (a.get() == b.get())
+		return true;
+	if (a->type() == b->type()) {
+		switch (a->type()) {
+		case Object::INT:
+			return static_cast<IntObject *>(a.get())->v == static_cast<IntObject *>(b.get())->v;
+		case Object::STR:
+			return static_cast<StrObject *>(a.get())->v == static_cast<StrObject *>(b.get())->v;
+		case Object::USTR:
+			return static_cast<UnicodeObject *>(a.get())->v == static_cast<UnicodeObject *>(b.get())->v;
+		case Object::CLASS:
+		case Object::INSTANCE:
+			return false; // hashed by identity
+		default:
+			break;
+		}
+	}
+	return objEquals(a, b, vm);
+}
+
 // this is opposed to bool_()
 bool asBool(const ObjRef &vref) {
 	Object *v = vref.get();
-	CHECK(v->type == Object::BOOL, "expected boolean");
+	CHECK(v->type() == Object::BOOL, "expected boolean");
 	return ((BoolObject *)v)->v;
 }
 
@@ -294,7 +360,7 @@ void print_recurse(const ObjRef &vref, std::ostream &out, RecurionTracker &track
 		out << "[nullptr]";
 		return;
 	}
-	switch (v->type) {
+	switch (v->type()) {
 	case Object::NONE:
 		out << "None";
 		break;
@@ -363,7 +429,7 @@ void print_recurse(const ObjRef &vref, std::ostream &out, RecurionTracker &track
 		for (int i = 0; i < lv->size(); ++i) {
 			if (i > 0)
 				out << ", ";
-			print_recurse(lv->v[i], out, tracker, true);
+			print_recurse(lv->at(i), out, tracker, true);
 		}
 		out << "]";
 		break;
@@ -413,11 +479,19 @@ static int64_t lenType(Object *arg) {
 	return checked_cast<OT>(arg)->v.size();
 }
 
+template <typename OT>
+ObjRef OpImp::concatList(Object *lhs, Object *rhs) {
+	auto nw = vm->alloct(new OT);
+	nw->allowUnboxed(vm);
+	nw->extend(*static_cast<OT *>(lhs));
+	nw->extend(*static_cast<OT *>(rhs));
+	return ObjRef(nw);
+}
+
 ObjRef OpImp::add(const ObjRef &lhsref, const ObjRef &rhsref) {
-	// TBD - lists, tuples
 	Object *lhs = lhsref.get(), *rhs = rhsref.get();
-	if (lhs->type == rhs->type) {
-		switch (rhs->type) {
+	if (lhs->type() == rhs->type()) {
+		switch (rhs->type()) {
 		case Object::INT:
 			return addType<IntObject>(lhs, rhs);
 		case Object::FLOAT:
@@ -426,27 +500,70 @@ ObjRef OpImp::add(const ObjRef &lhsref, const ObjRef &rhsref) {
 			return addType<StrObject>(lhs, rhs);
 		case Object::USTR:
 			return addType<UnicodeObject>(lhs, rhs);
+		case Object::LIST:
+			return concatList<ListObject>(lhs, rhs);
+		case Object::TUPLE:
+			return concatList<TupleObject>(lhs, rhs);
 		}
 	}
-	if (lhs->type == Object::STR && rhs->type == Object::USTR) {
-		UnicodeObject ulhs(((StrObject *)lhs)->v, ENC_ASCII);
-		return addType<UnicodeObject>(&ulhs, rhs);
-	}
-	if (lhs->type == Object::USTR && rhs->type == Object::STR) {
-		UnicodeObject urhs(((StrObject *)rhs)->v, ENC_ASCII);
-		return addType<UnicodeObject>(lhs, &urhs);
+	if ((lhs->type() == Object::STR && rhs->type() == Object::USTR) || (lhs->type() == Object::USTR && rhs->type() == Object::STR)) {
+		// widen the str part straight into the result
+		std::wstring r;
+		r.reserve(static_cast<StrBaseObject *>(lhs)->size() + static_cast<StrBaseObject *>(rhs)->size());
+		if (lhs->type() == Object::STR) {
+			const std::string &ls = static_cast<StrObject *>(lhs)->v;
+			r.append(ls.begin(), ls.end());
+			r += static_cast<UnicodeObject *>(rhs)->v;
+		} else {
+			const std::string &rs = static_cast<StrObject *>(rhs)->v;
+			r = static_cast<UnicodeObject *>(lhs)->v;
+			r.append(rs.begin(), rs.end());
+		}
+		return vm->alloc(new UnicodeObject(std::move(r)));
 	}
-	if ((lhs->type == Object::FLOAT && rhs->type == Object::INT)) {
+	if ((lhs->type() == Object::FLOAT && rhs->type() == Object::INT)) {
 		FloatObject floatRhs((float)((IntObject *)rhs)->v);
 		return addType<FloatObject>(lhs, &floatRhs);
 	}
-	if ((lhs->type == Object::INT && rhs->type == Object::FLOAT)) {
+	if ((lhs->type() == Object::INT && rhs->type() == Object::FLOAT)) {
 		FloatObject floatLhs((float)((IntObject *)lhs)->v);
 		return addType<FloatObject>(&floatLhs, rhs);
 	}
 	THROW("Can't add");
 }
 
+bool OpImp::addInPlace(const ObjRef &lhsref, const ObjRef &rhsref) {
+	Object *lhs = lhsref.get(), *rhs = rhsref.get();
+	if (lhs->type() == Object::LIST) { // list += is always in place, the change is seen by everyone who references it
+		CHECK(rhs->type() == Object::LIST || rhs->type() == Object::TUPLE, "can only extend a list with a list or a tuple");
+		static_cast<ListObject *>(lhs)->extend(*static_cast<ListObject *>(rhs));
+		return true;
+	}
+	// a string is immutable as long as anyone but the caller can see it. immortal constants never have a count of 1
+	if (lhsref.use_count() != 1)
+		return false;
+	if (lhs->type() == Object::STR && rhs->type() == Object::STR) {
+		auto *s = static_cast<StrObject *>(lhs);
+		s->changed();
+		size_t before = s->payloadSize();
+		s->v += static_cast<StrObject *>(rhs)->v; // std::string grows geometrically
+		s->payloadChanged(before);
+		return true;
+	}
+	if (lhs->type() == Object::USTR && (rhs->type() == Object::USTR || rhs->type() == Object::STR)) {
+		auto *s = static_cast<UnicodeObject *>(lhs);
+		s->changed();
+		size_t before = s->payloadSize();
+		if (rhs->type() == Object::USTR)
+			s->v += static_cast<UnicodeObject *>(rhs)->v;
+		else
+			s->v.append(static_cast<StrObject *>(rhs)->v.begin(), static_cast<StrObject *>(rhs)->v.end());
+		s->payloadChanged(before);
+		return true;
+	}
+	return false;
+}
+
 template <typename TC>
 ObjRef OpImp::multStr(Object *str, Object *num) {
 	const auto &s     = static_cast<PSTROBJ_TYPE(TC) *>(str)->v;
@@ -460,31 +577,31 @@ ObjRef OpImp::multStr(Object *str, Object *num) {
 ObjRef OpImp::mult(const ObjRef &lhsref, const ObjRef &rhsref) {
 	// TBD - lists, tuples
 	Object *lhs = lhsref.get(), *rhs = rhsref.get();
-	if (lhs->type == rhs->type) {
-		switch (rhs->type) {
+	if (lhs->type() == rhs->type()) {
+		switch (rhs->type()) {
 		case Object::INT:
 			return multType<IntObject>(lhs, rhs);
 		case Object::FLOAT:
 			return multType<FloatObject>(lhs, rhs);
 		}
 	}
-	if (lhs->type == Object::INT && rhs->type == Object::STR) {
+	if (lhs->type() == Object::INT && rhs->type() == Object::STR) {
 		return multStr<char>(rhs, lhs);
 	}
-	if (lhs->type == Object::STR && rhs->type == Object::INT) {
+	if (lhs->type() == Object::STR && rhs->type() == Object::INT) {
 		return multStr<char>(lhs, rhs);
 	}
-	if (lhs->type == Object::INT && rhs->type == Object::USTR) {
+	if (lhs->type() == Object::INT && rhs->type() == Object::USTR) {
 		return multStr<wchar_t>(rhs, lhs);
 	}
-	if (lhs->type == Object::USTR && rhs->type == Object::INT) {
+	if (lhs->type() == Object::USTR && rhs->type() == Object::INT) {
 		return multStr<wchar_t>(lhs, rhs);
 	}
-	if ((lhs->type == Object::FLOAT && rhs->type == Object::INT)) {
+	if ((lhs->type() == Object::FLOAT && rhs->type() == Object::INT)) {
 		FloatObject floatRhs((float)((IntObject *)rhs)->v);
 		return multType<FloatObject>(lhs, &floatRhs);
 	}
-	if ((lhs->type == Object::INT && rhs->type == Object::FLOAT)) {
+	if ((lhs->type() == Object::INT && rhs->type() == Object::FLOAT)) {
 		FloatObject floatLhs((float)((IntObject *)lhs)->v);
 		return multType<FloatObject>(&floatLhs, rhs);
 	}
@@ -494,17 +611,17 @@ ObjRef OpImp::mult(const ObjRef &lhsref, const ObjRef &rhsref) {
 ObjRef OpImp::sub(const ObjRef &lhsref, const ObjRef &rhsref) {
 	// TBD - lists, tuples
 	Object *lhs = lhsref.get(), *rhs = rhsref.get();
-	if (lhs->type == rhs->type) {
-		switch (rhs->type) {
+	if (lhs->type() == rhs->type()) {
+		switch (rhs->type()) {
 		case Object::INT:
 			return subType<IntObject>(lhs, rhs);
 		case Object::FLOAT:
 			return subType<FloatObject>(lhs, rhs);
 		}
-	} else if ((lhs->type == Object::FLOAT && rhs->type == Object::INT)) {
+	} else if ((lhs->type() == Object::FLOAT && rhs->type() == Object::INT)) {
 		FloatObject floatRhs((float)((IntObject *)rhs)->v);
 		return subType<FloatObject>(lhs, &floatRhs);
-	} else if ((lhs->type == Object::INT && rhs->type == Object::FLOAT)) {
+	} else if ((lhs->type() == Object::INT && rhs->type() == Object::FLOAT)) {
 		FloatObject floatLhs((float)((IntObject *)lhs)->v);
 		return subType<FloatObject>(&floatLhs, rhs);
 	}
@@ -514,17 +631,17 @@ ObjRef OpImp::sub(const ObjRef &lhsref, const ObjRef &rhsref) {
 ObjRef OpImp::div(const ObjRef &lhsref, const ObjRef &rhsref) {
 	// TBD - lists, tuples
 	Object *lhs = lhsref.get(), *rhs = rhsref.get();
-	if (lhs->type == rhs->type) {
-		switch (rhs->type) {
+	if (lhs->type() == rhs->type()) {
+		switch (rhs->type()) {
 		case Object::INT:
 			return divType<IntObject>(lhs, rhs);
 		case Object::FLOAT:
 			return divType<FloatObject>(lhs, rhs);
 		}
-	} else if ((lhs->type == Object::FLOAT && rhs->type == Object::INT)) {
+	} else if ((lhs->type() == Object::FLOAT && rhs->type() == Object::INT)) {
 		FloatObject floatRhs((float)((IntObject *)rhs)->v);
 		return divType<FloatObject>(lhs, &floatRhs);
-	} else if ((lhs->type == Object::INT && rhs->type == Object::FLOAT)) {
+	} else if ((lhs->type() == Object::INT && rhs->type() == Object::FLOAT)) {
 		FloatObject floatLhs((float)((IntObject *)lhs)->v);
 		return divType<FloatObject>(&floatLhs, rhs);
 	}
@@ -533,14 +650,14 @@ ObjRef OpImp::div(const ObjRef &lhsref, const ObjRef &rhsref) {
 
 ObjRef OpImp::uplus(const ObjRef &argref) {
 	Object *arg = argref.get();
-	if (arg->type == Object::INT || arg->type == Object::FLOAT) {
+	if (arg->type() == Object::INT || arg->type() == Object::FLOAT) {
 		return argref;
 	}
 	THROW("Can't unary positive");
 }
 ObjRef OpImp::uminus(const ObjRef &argref) {
 	Object *arg = argref.get();
-	switch (arg->type) {
+	switch (arg->type()) {
 	case Object::INT:
 		return minusType<IntObject>(arg);
 	case Object::FLOAT:
@@ -550,7 +667,7 @@ ObjRef OpImp::uminus(const ObjRef &argref) {
 }
 ObjRef OpImp::unot(const ObjRef &argref) {
 	Object *arg = argref.get();
-	if (arg->type == Object::BOOL) {
+	if (arg->type() == Object::BOOL) {
 		return vm->alloc(new BoolObject(!((BoolObject *)arg)->v));
 	}
 	THROW("Can't unary not");
@@ -559,11 +676,10 @@ ObjRef OpImp::unot(const ObjRef &argref) {
 static int64_t intLen(const ObjRef &argref) {
 	Object *arg = argref.get();
 
-	switch (arg->type) {
+	switch (arg->type()) {
 	case Object::LIST:
-		return lenType<ListObject>(arg);
 	case Object::TUPLE:
-		return lenType<TupleObject>(arg);
+		return static_cast<ListObject *>(arg)->size();
 	case Object::DICT:
 		return lenType<DictObject>(arg);
 	case Object::STRDICT:
@@ -589,10 +705,10 @@ int64_t lexical_cast(const std::wstring &s) {
 }
 
 ObjRef OpImp::int_(const ObjRef &arg) {
-	if (arg->type == Object::INT)
+	if (arg->type() == Object::INT)
 		return arg;
 	int64_t i = 0;
-	switch (arg->type) {
+	switch (arg->type()) {
 	case Object::STR:
 		i = lexical_cast(static_pcast<StrObject>(arg)->v);
 		break;
@@ -617,10 +733,10 @@ static bool boolFromStr(const std::basic_string<TC> &s) {
 }
 
 ObjRef OpImp::bool_(const ObjRef &arg) {
-	if (arg->type == Object::BOOL)
+	if (arg->type() == Object::BOOL)
 		return arg;
 	bool b;
-	switch (arg->type) {
+	switch (arg->type()) {
 	case Object::STR:
 		b = boolFromStr(static_pcast<StrObject>(arg)->v);
 		break;
@@ -650,15 +766,17 @@ ObjRef OpImp::bool_(const ObjRef &arg) {
 
 template <typename T>
 bool extractOrNone(const ObjRef &o, T *v) {
-	if (o->type == Object::NONE)
+	if (o->type() == Object::NONE)
 		return false;
 	*v = extract<T>(o);
 	return true;
 }
 
 ObjRef OpImp::apply_slice(const ObjRef &o, int *startp, int *endp) {
-	if (o->type != Object::STR) {
-		THROW("slice implemented only on strings. got " << o->typeName());
+	if (o->type() != Object::STR) {
+		CHECK(o->type() == Object::USTR || o->type() == Object::LIST || o->type() == Object::TUPLE, "can't slice " << o->typeName());
+		ObjRef slice = vm->alloc(new SliceObject(startp != nullptr, startp ? *startp : 0, endp != nullptr, endp ? *endp : 0, false, 1));
+		return o->as<ISubscriptable>()->getSubscr(slice, vm);
 	}
 	const std::string &s     = static_pcast<StrObject>(o)->v;
 	int                start = 0, end = 0;
@@ -673,11 +791,12 @@ ObjRef OpImp::apply_slice(const ObjRef &o, int *startp, int *endp) {
 		start = std::max(0, (int)s.length() + start);
 	if (end < 0)
 		end = (int)s.length() + end;
-	int         len = std::min((int)s.length(), end - start);
-	std::string res;
-	if (len > 0)
-		res = s.substr(start, len);
-	return vm->makeFromT(res);
+	int len = std::min((int)s.length() - start, end - start);
+	if (len <= 0)
+		return vm->makeFromT(std::string());
+	if (len == (int)s.length()) // strings are immutable, s[:] is s
+		return o;
+	return vm->alloc(new StrObject(std::string(s, start, len)));
 }
 
 static int64_t notMinusOne(int64_t h) {
@@ -687,10 +806,10 @@ static int64_t notMinusOne(int64_t h) {
 }
 
 int64_t hashNum(const Object *arg) {
-	if (arg == nullptr || arg->type == Object::NONE) {
+	if (arg == nullptr || arg->type() == Object::NONE) {
 		return 0x1234; // here None and nullptr object are treated the same
 	}
-	switch (arg->type) {
+	switch (arg->type()) {
 	case Object::BOOL:
 		return ((const BoolObject *)arg)->v ? 1 : 0;
 	case Object::INT: {
@@ -708,16 +827,18 @@ int64_t hashNum(const Object *arg) {
 	case Object::USTR:
 	case Object::STR: { // same as CPython
 		const StrBaseObject *s = (const StrBaseObject *)arg;
+		if (s->cachedHash != -1)
+			return s->cachedHash;
 		if (s->size() == 0)
-			return 0;
+			return s->cachedHash = 0;
 		int h = s->at(0) << 7;
 		for (int i = 0; i < s->size(); ++i)
 			h = (h * 1000003) ^ s->at(i);
 		h = h ^ (int)s->size();
-		return notMinusOne(h);
+		return s->cachedHash = notMinusOne(h);
 	}
 	case Object::TUPLE: {
-		const std::vector<ObjRef> v = ((ListObject *)arg)->v;
+		const std::vector<ObjRef> &v = ((ListObject *)arg)->objects();
 		int                       h = 0x345678;
 		for (size_t i = 0; i < v.size(); ++i)
 			h = (h * 1000003) ^ (int)hashNum(v[i].get());
@@ -762,6 +883,45 @@ int64_t binOp(int64_t a, int64_t b, uchar op) {
 	THROW("Unexpected op");
 }
 
+// same as CPython's string_concatenate(), looks ahead at the instruction that follows an add
+void Frame::releaseStoreTarget(const ObjRef &o) {
+	const std::string &code = m_code->m_co.co_code;
+	if (m_lasti + 3 >= code.size())
+		return;
+	uchar next  = code[m_lasti + 1];
+	int   param = (code[m_lasti + 2] & 0xFF) | (code[m_lasti + 3] << 8);
+	if (next == STORE_FAST) {
+		if (param < m_fastlocals.size() && m_fastlocals[param].get() == o.get())
+			m_fastlocals[param].reset();
+	} else if (next == STORE_NAME) {
+		auto it = locals().find(m_code->m_co.co_names[param]);
+		if (it != locals().end() && it->second.get() == o.get())
+			it->second.reset();
+	}
+}
+
+ObjRef Frame::callTempAttr(const ObjRef &o, const Name &name) {
+	if (o->type() == Object::INSTANCE)
+		return static_cast<InstanceObject *>(o.get())->simple_attr(name, &m_callMethod); // null for __getattr__, done the usual way
+	if (!PrimitiveAttrAdapter::adaptedType(o->type()))
+		return ObjRef();
+	if (m_callAdapter.use_count() == 1) {
+		auto *a   = static_cast<PrimitiveAttrAdapter *>(m_callAdapter.get());
+		a->m_obj  = o;
+		a->m_name = name;
+	} else {
+		m_callAdapter = alloc(new PrimitiveAttrAdapter(o, name, m_vm));
+	}
+	return m_callAdapter;
+}
+
+void Frame::releaseCallTemps() {
+	if (m_callMethod.use_count() == 1)
+		static_cast<MethodObject *>(m_callMethod.get())->m_self.reset();
+	if (m_callAdapter.use_count() == 1)
+		static_cast<PrimitiveAttrAdapter *>(m_callAdapter.get())->m_obj.reset();
+}
+
 void Frame::doOpcode(SetObjCallback &setObj) {
 	CodeDefinition &c = m_code->m_co;
 	Instruction     ins(c.co_code[m_lasti]);
@@ -781,13 +941,13 @@ void Frame::doOpcode(SetObjCallback &setObj) {
 		m_fastlocals[ins.param] = pop();
 		break;
 	case LOAD_NAME: { // can be done with just the index
-		const std::string &name = c.co_names[ins.param];
+		const Name &name = c.co_names[ins.param];
 		ObjRef             v    = tryLookup(locals(), name);
 		if (v.isNull()) {
 			v = lookupGlobal(name);
 			CHECK(!v.isNull(), "Name not found `" << name << "`");
 		}
-		push(v);
+		push(std::move(v));
 		break;
 	}
 	case STORE_NAME:
@@ -856,6 +1016,18 @@ void Frame::doOpcode(SetObjCallback &setObj) {
 	case BINARY_ADD: {
 		ObjRef rhs = pop();
 		ObjRef lhs = pop();
+		if (isStrType(lhs->type()) && isStrType(rhs->type())) {
+			// `s = s + x` or `s += x`: the variable is overwritten next anyway, without its reference s can be appended to
+			releaseStoreTarget(lhs);
+			if (op.addInPlace(lhs, rhs)) {
+				push(std::move(lhs));
+				break;
+			}
+		} else if (ins.opcode == INPLACE_ADD && lhs->type() == Object::LIST) {
+			op.addInPlace(lhs, rhs);
+			push(std::move(lhs));
+			break;
+		}
 		push(op.add(lhs, rhs));
 		break;
 	}
@@ -897,16 +1069,17 @@ void Frame::doOpcode(SetObjCallback &setObj) {
 		setObj(SLOT_RETVAL, pop());
 		return; // don't increment m_lasti so we'll know where we returned for debugging
 	case LOAD_GLOBAL: {
-		const std::string &name = c.co_names[ins.param];
+		const Name &name = c.co_names[ins.param];
 		ObjRef             v    = lookupGlobal(name);
 		CHECK(!v.isNull(), "Unable to find global `" << name << "`");
-		push(v);
+		push(std::move(v));
 		break;
 	}
 	case CALL_FUNCTION: {
 		int posCount = ins.param & 0xFF;
 		int kwCount  = ins.param >> 8;
 		push(m_vm->callFunction(*this, posCount, kwCount));
+		releaseCallTemps();
 		break;
 	}
 	case POP_TOP:
@@ -933,14 +1106,14 @@ void Frame::doOpcode(SetObjCallback &setObj) {
 			// create unbounded methods for class
 			if (it->first == "__metaclass__") // can be a function but should not be made into a method.
 				continue;
-			if (it->second->type == Object::FUNC) {
+			if (it->second->type() == Object::FUNC) {
 				auto cb               = checked_dynamic_pcast<CallableObject>(it->second);
 				methods->v[it->first] = (cb->m_isStaticMethod) ? ObjRef(cb) : alloc(new MethodObject(cb, InstanceObjRef()));
 			}
 		}
 		ObjRef metahook = tryLookup(methods->v, "__metaclass__");
 		if (metahook.isNull() && bases->size() > 0) {
-			metahook = bases->v[0]->attr("__metaclass__");
+			metahook = bases->objects()[0]->attr("__metaclass__");
 		}
 		ObjRef cls;
 		if (!metahook.isNull()) {
@@ -951,21 +1124,27 @@ void Frame::doOpcode(SetObjCallback &setObj) {
 			}
 			// this implementation of metaclass is not quite full. there is no support for __new__ or __init__ of the metaclass. so basically it can just be a function.
 		} else {
-			cls = alloc(new ClassObject(methods, bases->v, name->v, m_module, m_vm));
+			cls = alloc(new ClassObject(methods, bases->objects(), name->v, m_module, m_vm));
 		}
-		push(cls);
+		push(std::move(cls));
 		break;
 	}
 	case LOAD_ATTR: {
-		const std::string &name = c.co_names[ins.param];
+		const Name &name = c.co_names[ins.param];
 		ObjRef             o    = pop();
 		CHECK(!o.isNull(), "attribute of None object " << name);
-		IAttrable *attrb = o->tryAs<IAttrable>();
-		if (attrb) {
-			ObjRef r = attrb->attr(name);
+		if (m_lasti < m_code->m_callTemps.size() && m_code->m_callTemps[m_lasti]) {
+			ObjRef r = callTempAttr(o, name);
+			if (!r.isNull()) {
+				push(std::move(r));
+				break;
+			}
+		}
+		if (o->hasProp(Object::IATTRABLE)) {
+			ObjRef r = o->attr(name);
 			CHECK(!r.isNull(), "attribute `" << name << "` does not exist in " << stdstr(o, false));
-			push(r);
-		} else if (PrimitiveAttrAdapter::adaptedType(o->type)) {
+			push(std::move(r));
+		} else if (PrimitiveAttrAdapter::adaptedType(o->type())) {
 			push(m_vm->alloc(new PrimitiveAttrAdapter(o, name, m_vm)));
 		} else {
 			THROW("Object of type " << o->typeName() << " does not have attribute `" << name << "`");
@@ -975,8 +1154,7 @@ void Frame::doOpcode(SetObjCallback &setObj) {
 	case STORE_ATTR: {
 		ObjRef o = pop();
 		CHECK(!o.isNull(), "set attribute of None object");
-		IAttrable *attrb = o->as<IAttrable>();
-		attrb->setattr(c.co_names[ins.param], pop());
+		o->setattr(c.co_names[ins.param], pop());
 		break;
 	}
 	case BUILD_LIST:
@@ -1009,7 +1187,7 @@ void Frame::doOpcode(SetObjCallback &setObj) {
 		IIterator *it = top()->as<IIterator>();
 		ObjRef     nx;
 		if (it->next(nx))
-			push(nx);
+			push(std::move(nx));
 		else {
 			pop();
 			m_lasti += ins.param;
@@ -1022,9 +1200,12 @@ void Frame::doOpcode(SetObjCallback &setObj) {
 	case POP_BLOCK:
 		popBlock();
 		break;
-	case BUILD_MAP:
-		push(alloc(new DictObject(m_vm)));
+	case BUILD_MAP: {
+		auto d = new DictObject(m_vm);
+		d->v.reserve(ins.param); // the number of STORE_MAPs that follow
+		push(alloc(d));
 		break;
+	}
 	case STORE_MAP: {
 		ObjRef     key = pop();
 		ObjRef     val = pop();
@@ -1132,6 +1313,84 @@ void Frame::doOpcode(SetObjCallback &setObj) {
 		m_lasti += 2;
 };
 
+// how many values an instruction pops and pushes, for the instructions markCallTemps() can follow. false for others
+static bool stackEffect(uchar opc, int param, int *pops, int *pushes) {
+	*pops   = 0;
+	*pushes = 1;
+	switch (opc) {
+	case LOAD_FAST:
+	case LOAD_CONST:
+	case LOAD_NAME:
+	case LOAD_GLOBAL:
+		return true;
+	case LOAD_ATTR:
+	case UNARY_POSITIVE:
+	case UNARY_NEGATIVE:
+	case UNARY_NOT:
+	case UNARY_INVERT:
+		*pops = 1;
+		return true;
+	case BINARY_MULTIPLY:
+	case BINARY_DIVIDE:
+	case BINARY_ADD:
+	case BINARY_SUBTRACT:
+	case BINARY_SUBSCR:
+	case BINARY_LSHIFT:
+	case BINARY_RSHIFT:
+	case BINARY_AND:
+	case BINARY_XOR:
+	case BINARY_OR:
+	case COMPARE_OP:
+		*pops = 2;
+		return true;
+	case BUILD_TUPLE:
+	case BUILD_LIST:
+		*pops = param;
+		return true;
+	case CALL_FUNCTION:
+		*pops = (param & 0xFF) + (param >> 8) * 2 + 1;
+		return true;
+	}
+	return false;
+}
+
+// marks the LOAD_ATTR instructions whose result is only the function of the CALL_FUNCTION that follows, like
+// `s.strip()` or `self.f(a, b + 1)`. the arguments in between are followed on the value stack. anything that is
+// not a simple expression, or that a jump lands in the middle of, leaves the LOAD_ATTR unmarked
+static void markCallTemps(CodeObject *obj) {
+	const std::string &c = obj->m_co.co_code;
+	auto               paramAt = [&](size_t i) { return (c[i + 1] & 0xFF) | (c[i + 2] << 8); };
+	std::vector<bool>  target(c.size() + 1, false);
+	for (size_t i = 0; i < c.size(); i += (uchar)c[i] >= HAVE_ARGUMENT ? 3 : 1) {
+		uchar opc = c[i];
+		if (opc < HAVE_ARGUMENT || i + 2 >= c.size())
+			continue;
+		size_t to = (opFlags(opc) & JREL) ? i + 3 + paramAt(i) : (opFlags(opc) & JABS) ? paramAt(i) : c.size();
+		if (to < c.size())
+			target[to] = true;
+	}
+	obj->m_callTemps.assign(c.size(), false);
+	for (size_t i = 0; i + 2 < c.size(); i += (uchar)c[i] >= HAVE_ARGUMENT ? 3 : 1) {
+		if ((uchar)c[i] != LOAD_ATTR)
+			continue;
+		int above = 0; // values pushed on top of the attribute
+		for (size_t j = i + 3; j < c.size() && !target[j]; j += (uchar)c[j] >= HAVE_ARGUMENT ? 3 : 1) {
+			uchar opc   = c[j];
+			int   param = (opc >= HAVE_ARGUMENT && j + 2 < c.size()) ? paramAt(j) : 0;
+			int   pops, pushes;
+			if (!stackEffect(opc, param, &pops, &pushes))
+				break;
+			if (opc == CALL_FUNCTION && pops == above + 1) {
+				obj->m_callTemps[i] = true;
+				break;
+			}
+			if (pops > above) // the attribute is used by something else
+				break;
+			above += pushes - pops;
+		}
+	}
+}
+
 void PyVM::validateCode(const CodeObjRef &obj) {
 	// check that all the opcodes in all code constants are implemented.
 	const std::string &c = obj->m_co.co_code;
@@ -1143,6 +1402,7 @@ void PyVM::validateCode(const CodeObjRef &obj) {
 		if (opc >= HAVE_ARGUMENT)
 			i += 2;
 	}
+	markCallTemps(obj.get());
 	for (const auto &o : obj->m_co.co_consts) {
 		CodeObjRef co = dynamic_pcast<CodeObject>(o);
 		if (!co.isNull())
@@ -1150,7 +1410,7 @@ void PyVM::validateCode(const CodeObjRef &obj) {
 	}
 }
 
-ObjRef Builtins::get(const std::string &name) {
+ObjRef Builtins::get(const Name &name) {
 	return attr(name);
 }
 
@@ -1176,16 +1436,26 @@ int checkVmVersion(int req) {
 	return vmVersion();
 }
 
-// works only for IAttrables at the moment
+// the attribute of o named by a string from data, which isn't interned to look it up. a name that was never
+// interned is no attribute of anything, only __getattr__ of an instance can still make it
+static ObjRef attrByStr(const ObjRef &o, const std::string &name) {
+	if (!o->hasProp(Object::IATTRABLE))
+		return ObjRef();
+	const Atom *a = Atom::find(name);
+	if (a != nullptr)
+		return o->attr(Name(a));
+	if (o->type() == Object::INSTANCE)
+		return static_pcast<InstanceObject>(o)->getattrHook(name);
+	return ObjRef();
+}
+
+// works only for IATTRABLE objects at the moment
 ObjRef getattr(const std::vector<ObjRef> &args) {
 	CHECK(args.size() == 2 || args.size() == 3, "getattr expects 2 or 3 arguments, got " << args.size());
 	std::string name  = extract<std::string>(args[1]);
-	IAttrable * attrb = args[0]->tryAs<IAttrable>();
-	if (attrb != nullptr) {
-		ObjRef v = attrb->attr(name);
-		if (!v.isNull())
-			return v;
-	}
+	ObjRef      v     = attrByStr(args[0], name);
+	if (!v.isNull())
+		return v;
 	// not found
 	if (args.size() == 3)
 		return args[2];
@@ -1196,12 +1466,12 @@ ObjRef math_round(CallArgs &args, PyVM *vm) {
 	CHECK(args.pos.size() == 1, "round expects 1 argument, got " << args.pos.size());
 	ObjRef arg = args[0];
 	double res;
-	if (arg->type == Object::FLOAT) {
+	if (arg->type() == Object::FLOAT) {
 		double val = extract<double>(arg);
 		res        = std::round(val);
 		return vm->makeFromT<double>(res);
 	}
-	if (arg->type == Object::INT) {
+	if (arg->type() == Object::INT) {
 		int val = extract<int>(arg);
 		return vm->makeFromT(val);
 	}
@@ -1210,12 +1480,7 @@ ObjRef math_round(CallArgs &args, PyVM *vm) {
 }
 
 bool hasattr(ObjRef o, const std::string &name) {
-	IAttrable *attrb = o->tryAs<IAttrable>();
-	if (attrb != nullptr) {
-		ObjRef v = attrb->attr(name);
-		return !v.isNull();
-	}
-	return false;
+	return !attrByStr(o, name).isNull();
 }
 
 ObjRef strdict(CallArgs &args, PyVM *vm) {
@@ -1335,7 +1600,7 @@ ObjRef OpImp::runtime_import(const ObjRef& filenameObj)
 ObjRef type_(CallArgs &args, PyVM *vm) {
 	CHECK(args.pos.size() == 3, "Wrong number of arguments to type()");
 	auto name    = extract<std::string>(args.pos[0]);
-	auto bases   = checked_cast<TupleObject>(args.pos[1])->v;
+	auto bases   = checked_cast<TupleObject>(args.pos[1])->objects();
 	auto methods = checked_cast<StrDictObject>(args.pos[2]);
 	// the module is set in BUILD_CLASS
 	return vm->alloc(new ClassObject(methods, bases, name, ModuleObjRef(), vm)); // module will be inited in BUILD_CLASS
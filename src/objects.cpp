@@ -13,9 +13,12 @@
 
 #include "PyVM/OpImp.h"
 #include "PyVM/PyVM.h"
+#include "PyVM/StrKernels.h"
 #include "PyVM/objects.h"
 
+#include <algorithm>
 #include <cstring>
+#include <iterator>
 
 const char *Object::typeName(Type type) {
 	switch (type) {
@@ -143,11 +146,219 @@ int ISubscriptable::extractIndex(const ObjRef &key, size_t size) {
 
 //------------------------------------------------------------------------------------------
 
+// the strategy a list of only a's would have
+static ListObject::Strategy strategyOf(const ObjRef &a) {
+	if (a.isNull())
+		return ListObject::OBJECTS;
+	if (a->type() == Object::INT)
+		return ListObject::INTS;
+	if (a->type() == Object::FLOAT)
+		return ListObject::FLOATS;
+	return ListObject::OBJECTS;
+}
+
+void ListObject::clear() {
+	m_objs.clear();
+	m_ints.clear();
+	m_floats.clear();
+	m_strategy = OBJECTS;
+}
+
+void ListObject::allowUnboxed(PyVM *vm) {
+	if (type() != LIST)
+		return;
+	m_vm = vm;
+	if (m_strategy != OBJECTS || m_objs.empty())
+		return;
+	Strategy s = strategyOf(m_objs[0]);
+	for (const auto &o : m_objs)
+		if (s == OBJECTS || strategyOf(o) != s)
+			return;
+	size_t before = payloadSize();
+	if (s == INTS) {
+		m_ints.reserve(m_objs.size());
+		for (const auto &o : m_objs)
+			m_ints.push_back(static_cast<IntObject *>(o.get())->v);
+	} else {
+		m_floats.reserve(m_objs.size());
+		for (const auto &o : m_objs)
+			m_floats.push_back(static_cast<FloatObject *>(o.get())->v);
+	}
+	std::vector<ObjRef>().swap(m_objs);
+	m_strategy = s;
+	payloadChanged(before);
+}
+
+void ListObject::generalize() {
+	size_t              before = payloadSize();
+	std::vector<ObjRef> objs;
+	objs.reserve(size());
+	for (int i = 0; i < size(); ++i)
+		objs.push_back(at(i));
+	m_objs.swap(objs);
+	std::vector<int64_t>().swap(m_ints);
+	std::vector<double>().swap(m_floats);
+	m_strategy = OBJECTS;
+	payloadChanged(before);
+}
+
+ObjRef ListObject::at(int i) const {
+	switch (m_strategy) {
+	case INTS:
+		return m_vm->makeFromT(m_ints[i]);
+	case FLOATS:
+		return m_vm->makeFromT(m_floats[i]);
+	default:
+		return m_objs[i];
+	}
+}
+
+bool ListObject::fitsUnboxed(const ObjRef &a) {
+	Strategy s = strategyOf(a);
+	if (s == OBJECTS)
+		return false;
+	if (m_strategy == OBJECTS && m_vm != nullptr && m_objs.empty())
+		m_strategy = s;
+	return m_strategy == s;
+}
+
+void ListObject::appendSlow(const ObjRef &a) {
+	bool fits = fitsUnboxed(a);
+	if (!fits && m_strategy != OBJECTS)
+		generalize();
+	size_t before = payloadSize();
+	if (!fits)
+		m_objs.push_back(a);
+	else if (m_strategy == INTS)
+		m_ints.push_back(static_cast<IntObject *>(a.get())->v);
+	else
+		m_floats.push_back(static_cast<FloatObject *>(a.get())->v);
+	payloadChanged(before);
+}
+
+void ListObject::prepend(const ObjRef &a) {
+	bool fits = fitsUnboxed(a);
+	if (!fits && m_strategy != OBJECTS)
+		generalize();
+	size_t before = payloadSize();
+	if (!fits)
+		m_objs.insert(m_objs.begin(), a);
+	else if (m_strategy == INTS)
+		m_ints.insert(m_ints.begin(), static_cast<IntObject *>(a.get())->v);
+	else
+		m_floats.insert(m_floats.begin(), static_cast<FloatObject *>(a.get())->v);
+	payloadChanged(before);
+}
+
+void ListObject::extend(const ListObject &o) {
+	int n = o.size();
+	if (n == 0)
+		return;
+	if (m_strategy == OBJECTS && m_objs.empty() && m_vm != nullptr && o.m_strategy != OBJECTS)
+		m_strategy = o.m_strategy;
+	size_t before = payloadSize();
+	if (m_strategy == INTS && o.m_strategy == INTS) {
+		m_ints.reserve(m_ints.size() + n);
+		std::copy_n(o.m_ints.begin(), n, std::back_inserter(m_ints)); // o can be this
+	} else if (m_strategy == FLOATS && o.m_strategy == FLOATS) {
+		m_floats.reserve(m_floats.size() + n);
+		std::copy_n(o.m_floats.begin(), n, std::back_inserter(m_floats));
+	} else if (m_strategy == OBJECTS && o.m_strategy == OBJECTS) {
+		m_objs.reserve(m_objs.size() + n);
+		std::copy_n(o.m_objs.begin(), n, std::back_inserter(m_objs));
+	} else {
+		for (int i = 0; i < n; ++i) // the first element that doesn't fit makes this generic, which o can't be now
+			append(o.at(i));
+		return; // append() accounted the growth
+	}
+	payloadChanged(before);
+}
+
+ObjRef ListObject::pop(int index) {
+	ObjRef ref;
+	switch (m_strategy) {
+	case INTS:
+		ref = m_vm->makeFromT(m_ints.at(index));
+		m_ints.erase(m_ints.begin() + index);
+		break;
+	case FLOATS:
+		ref = m_vm->makeFromT(m_floats.at(index));
+		m_floats.erase(m_floats.begin() + index);
+		break;
+	default:
+		ref = m_objs.at(index);
+		m_objs.erase(m_objs.begin() + index);
+	}
+	return ref;
+}
+
+ObjRef ListObject::getSubscr(const ObjRef &key, PyVM *vm) {
+	if (key->type() != Object::SLICE)
+		return at(extractIndex(key, size()));
+	auto *slice = static_cast<SliceObject *>(key.get());
+	// a tuple is immutable so a slice of all of it is the tuple itself, like in CPython
+	if (type() != LIST && slice->indices(size()) == size() && slice->step == 1)
+		return ObjRef(this);
+	if (m_strategy == OBJECTS)
+		return vm->makeFromT(slice->slice_step(m_objs));
+	auto *ret       = new ListObject; // filled before it is allocated so its payload is accounted
+	ret->m_vm       = m_vm;
+	ret->m_strategy = m_strategy;
+	if (m_strategy == INTS)
+		ret->m_ints = slice->slice_step(m_ints);
+	else
+		ret->m_floats = slice->slice_step(m_floats);
+	return vm->alloc(ret);
+}
+
+void ListObject::setSubscr(const ObjRef &key, const ObjRef &value) {
+	int i = extractIndex(key, size());
+	if (!fitsUnboxed(value))
+		objects()[i] = value;
+	else if (m_strategy == INTS)
+		m_ints[i] = static_cast<IntObject *>(value.get())->v;
+	else
+		m_floats[i] = static_cast<FloatObject *>(value.get())->v;
+}
+
+namespace {
+struct ListIterObject : public IteratorObject, public IIterable {
+	DEFINE_OBJECT_SIZE
+	ListIterObject(const ListObjRef &l)
+		: of(l) {}
+	void clear() override {
+		of.reset();
+	}
+	void traverse(const ObjVisitor &v) override {
+		visitRef(v, of);
+	}
+	bool next(ObjRef &obj) override {
+		if (i >= of->size())
+			return false;
+		obj = of->at(i++);
+		return true;
+	}
+	ObjRef iter(PyVM *_vm) override {
+		(void)_vm;
+		return ObjRef(this);
+	}
+
+	int        i = 0;
+	ListObjRef of;
+};
+} // namespace
+
+ObjRef ListObject::iter(PyVM *_vm) {
+	return _vm->alloc(new ListIterObject(ListObjRef(this)));
+}
+
+//------------------------------------------------------------------------------------------
+
 ObjRef UnicodeObject::fromStr(const ObjRef &s, PyVM *vm) {
 	return vm->alloc(new UnicodeObject(checked_dynamic_pcast<StrObject>(s)));
 }
 
-ObjRef ClassObject::attr(const std::string &name) {
+ObjRef ClassObject::attr(const Name &name) {
 	ObjRef v = tryLookup(m_dict->v, name);
 	if (!v.isNull())
 		return v;
@@ -163,9 +374,52 @@ PoolPtr<MethodObject> MethodObject::bind(const InstanceObjRef &newself) {
 	return newself->m_class->m_vm->alloct(new MethodObject(m_func, newself));
 }
 
-ObjRef InstanceObject::simple_attr(const std::string &name) {
+ObjRef InstanceObject::ownAttr(const Name &name) const {
+	if (m_shape != nullptr) {
+		int s = m_shape->slotOf(name);
+		return (s < 0) ? ObjRef() : m_slots[s];
+	}
+	if (m_dict)
+		return tryLookup(*m_dict, name);
+	return ObjRef();
+}
+
+void InstanceObject::setattr(const Name &name, const ObjRef &o) {
+	if (m_shape != nullptr) {
+		int s = m_shape->slotOf(name);
+		if (s >= 0) {
+			m_slots[s] = o;
+			return;
+		}
+		size_t before = payloadSize();
+		Shape *next   = m_shape->withAdded(name);
+		if (next != nullptr) {
+			m_shape = next;
+			m_slots.push_back(o);
+			payloadChanged(before);
+			return;
+		}
+		// too many attributes or too many different shapes, move to a dictionary.
+		// it's made apart so that the instance is consistent if accounting it throws a MemoryError
+		NameDict d;
+		for (int i = 0; i < m_slots.size(); ++i)
+			d[m_shape->nameAt(i)] = m_slots[i];
+		m_dict.reset(new NameDict(std::move(d), this));
+		m_slots.clear();
+		m_shape = nullptr;
+		payloadChanged(before);
+	}
+	if (!m_dict) {
+		size_t before = payloadSize();
+		m_dict.reset(new NameDict(this));
+		payloadChanged(before);
+	}
+	(*m_dict)[name] = o; // accounted by the dict
+}
+
+ObjRef InstanceObject::simple_attr(const Name &name, ObjRef *reuse) {
 	// try in the instance
-	ObjRef v = tryLookup(m_dict, name);
+	ObjRef v = ownAttr(name);
 	if (!v.isNull())
 		return v;
 	// try in the class
@@ -175,10 +429,20 @@ ObjRef InstanceObject::simple_attr(const std::string &name) {
 			// if it's a method, need to create a new bounded method object
 			// the methods are not saved in the instance object to avoid a cycle instance->method->(m_self)instance
 			// this is the way it is done in CPython
-			if (v->type == Object::METHOD) {
+			if (v->type() == Object::METHOD) {
 				MethodObjRef m = checked_cast<MethodObject>(v);
+				if (reuse != nullptr && reuse->use_count() == 1) {
+					auto *r     = static_cast<MethodObject *>(reuse->get());
+					r->m_module = m->m_func->m_module;
+					r->m_func   = m->m_func;
+					r->m_self   = InstanceObjRef(this);
+					return ObjRef(r);
+				}
 				// same as bind(), without the checks
-				return m_class->m_vm->alloc(new MethodObject(m->m_func, InstanceObjRef(this)));
+				ObjRef b = m_class->m_vm->alloc(new MethodObject(m->m_func, InstanceObjRef(this)));
+				if (reuse != nullptr)
+					*reuse = b;
+				return b;
 			}
 			return v;
 		}
@@ -186,12 +450,16 @@ ObjRef InstanceObject::simple_attr(const std::string &name) {
 	return ObjRef();
 }
 
-ObjRef InstanceObject::attr(const std::string &name) {
+ObjRef InstanceObject::attr(const Name &name) {
 	ObjRef v = simple_attr(name);
 	if (!v.isNull())
 		return v;
+	return getattrHook(name.str());
+}
 
-	ObjRef getatt = simple_attr("__getattr__");
+ObjRef InstanceObject::getattrHook(const std::string &name) {
+	static const Name s_getattr("__getattr__");
+	ObjRef            getatt = simple_attr(s_getattr);
 	if (!getatt.isNull()) {
 		std::vector<ObjRef> gargs;
 		gargs.push_back(m_class->m_vm->makeFromT(name));
@@ -204,7 +472,7 @@ ObjRef InstanceObject::attr(const std::string &name) {
 			throw;
 		}
 	}
-	return v;
+	return ObjRef();
 }
 
 int toSlash(int c) {
@@ -228,61 +496,103 @@ static void checkArgCountS(Object::Type t, const CallArgs::TPosVector &args, int
 	CHECK(args.size() == c, "method " << Object::typeName(t) << "." << name << " takes exactly " << c << "arguments (" << args.size() << " given)");
 }
 void PrimitiveAttrAdapter::checkArgCount(const ObjRef obj, const CallArgs::TPosVector &args, int c) {
-	checkArgCountS(obj->type, args, c, m_name);
+	checkArgCountS(obj->type(), args, c, m_name);
 }
 
-// casei: case insensitive compare
-// slashi: slash insensitive compare
 template <typename TC>
-static bool stringQuery(const ObjRef &thisv, const CallArgs::TPosVector &args, StrOp op, StrModifier mod) {
-	checkArgCountS(Object::STR, args, 1, "cmp"); // STR is just for logging
-	const std::basic_string<TC> *a = extractStrPtr<TC>(args[0], mod);
-	const std::basic_string<TC> *v = extractStrPtr<TC>(thisv, mod);
+static bool queryStr(const std::basic_string<TC> &v, const std::basic_string<TC> &a, StrOp op) {
+	if (a.size() > v.size())
+		return false;
+	switch (op) {
+	case SO_CONTAINS:
+		return v.find(a) != std::basic_string<TC>::npos;
+	case SO_BEGINS:
+		return std::memcmp(v.data(), a.data(), a.size() * sizeof(TC)) == 0;
+	case SO_ENDS:
+		return std::memcmp(v.data() + v.size() - a.size(), a.data(), a.size() * sizeof(TC)) == 0;
+	case SO_EQUALS:
+		return a == v;
+	}
+	return false;
+}
 
-	if (a->size() > v->size())
+// wide strings are compared through the lower case copies cached in their extensions
+template <typename TC>
+static bool queryCaseI(const ObjRef &thisv, const ObjRef &arg, StrOp op) {
+	return queryStr(*extractStrPtr<TC>(thisv, STRMOD_CASEI), *extractStrPtr<TC>(arg, STRMOD_CASEI), op);
+}
+
+// byte strings are folded while they are scanned, no lower case copy is made
+template <>
+bool queryCaseI<char>(const ObjRef &thisv, const ObjRef &arg, StrOp op) {
+	const std::string &a = *extractStrPtr<char>(arg, STRMOD_NONE);
+	const std::string &v = *extractStrPtr<char>(thisv, STRMOD_NONE);
+	if (a.size() > v.size())
 		return false;
 	switch (op) {
 	case SO_CONTAINS:
-		return v->find(*a) != std::basic_string<TC>::npos;
+		return iFindAscii(v.data(), v.size(), a.data(), a.size()) != std::string::npos;
 	case SO_BEGINS:
-		return std::memcmp(v->data(), a->data(), a->size() * sizeof(TC)) == 0;
+		return iEqualsAscii(v.data(), a.data(), a.size());
 	case SO_ENDS:
-		return std::memcmp(v->data() + v->size() - a->size(), a->data(), a->size() * sizeof(TC)) == 0;
+		return iEqualsAscii(v.data() + v.size() - a.size(), a.data(), a.size());
 	case SO_EQUALS:
-		return *a == *v;
+		return a.size() == v.size() && iEqualsAscii(v.data(), a.data(), a.size());
 	}
 	return false;
 }
 
+// casei: case insensitive compare
+// slashi: slash insensitive compare
+template <typename TC>
+static bool stringQuery(const ObjRef &thisv, const CallArgs::TPosVector &args, StrOp op, StrModifier mod) {
+	checkArgCountS(Object::STR, args, 1, "cmp"); // STR is just for logging
+	if (mod == STRMOD_CASEI)
+		return queryCaseI<TC>(thisv, args[0], op);
+	return queryStr(*extractStrPtr<TC>(thisv, mod), *extractStrPtr<TC>(args[0], mod), op);
+}
+
+// the next whitespace (" \t\n\r") in s at or after from, npos if none
+static size_t findSpace(const std::string &s, size_t from) {
+	size_t i = from + findWhitespace(s.data() + from, s.size() - from);
+	return i == s.size() ? std::string::npos : i;
+}
+static size_t findSpace(const std::wstring &s, size_t from) {
+	return s.find_first_of(L" \t\n\r", from);
+}
+
 // takes 2 optional arguments
 // arg 1: separator (if not given, using white-space)
 // arg 2: if separator is given, should we add empty elements. default is true (while-space split always ignores empty elements)
+// the string is read in place, every piece is copied once, directly into its new object
 template <typename TC>
 static ObjRef split(const ObjRef &o, const CallArgs::TPosVector &args, PyVM *vm) {
-	std::basic_string<TC> s   = extract<std::basic_string<TC>>(o);
-	ListObjRef            ret = vm->alloct(new ListObject);
+	const std::basic_string<TC> &s   = *extractStrPtr<TC>(o, STRMOD_NONE);
+	ListObjRef                   ret = vm->alloct(new ListObject);
+	auto addPiece = [&](size_t from, size_t to) {
+		ret->append(vm->alloc(new PSTROBJ_TYPE(TC)(std::basic_string<TC>(s, from, to - from))));
+	};
 	if (args.size() == 1 || args.size() == 2) {
-		std::basic_string<TC> sep      = extract<std::basic_string<TC>>(args[0]);
-		bool                  addEmpty = true; // the default documented behaviour
+		const std::basic_string<TC> &sep      = *extractStrPtr<TC>(args[0], STRMOD_NONE);
+		bool                         addEmpty = true; // the default documented behaviour
 		if (args.size() == 2)
 			addEmpty = extract<bool>(args[1]);
+		CHECK(!sep.empty(), "ValueError: empty separator");
 		size_t next = 0, current = 0;
 		do {
-			next                    = s.find(sep, current);
-			std::basic_string<TC> v = s.substr(current, next - current);
-			if (!v.empty() || addEmpty) {
-				ret->append(vm->alloc(new PSTROBJ_TYPE(TC)(v)));
-			}
+			next       = s.find(sep, current);
+			size_t end = std::min(next, s.size());
+			if (end > current || addEmpty)
+				addPiece(current, end);
 			current = next + sep.size();
 		} while (next != std::string::npos);
 	} else if (args.size() == 0) {
 		size_t next = 0, current = 0;
 		do {
-			next                    = s.find_first_of(LITERAL_TSTR(TC, " \t\n\r"), current);
-			std::basic_string<TC> v = s.substr(current, next - current);
-			if (!v.empty()) {
-				ret->append(vm->alloc(new PSTROBJ_TYPE(TC)(v)));
-			}
+			next       = findSpace(s, current);
+			size_t end = std::min(next, s.size());
+			if (end > current)
+				addPiece(current, end);
 			current = next + 1;
 		} while (next != std::string::npos);
 	} else
@@ -291,30 +601,45 @@ static ObjRef split(const ObjRef &o, const CallArgs::TPosVector &args, PyVM *vm)
 	return ObjRef(ret);
 }
 
+// the size of the result is computed first so it's filled in a single allocation
+template <typename TC>
+static ObjRef joinParts(const ObjRef &sepObj, const std::vector<ObjRef> &parts, PyVM *vm) {
+	const std::basic_string<TC> &sep  = *extractStrPtr<TC>(sepObj, STRMOD_NONE);
+	size_t                       size = sep.size() * (parts.size() - 1);
+	for (const auto &p : parts)
+		size += extractStrPtr<TC>(p, STRMOD_NONE)->size();
+	std::basic_string<TC> r;
+	r.reserve(size);
+	for (size_t i = 0; i < parts.size(); ++i) {
+		if (i > 0)
+			r += sep;
+		r += *extractStrPtr<TC>(parts[i], STRMOD_NONE);
+	}
+	return vm->alloc(new PSTROBJ_TYPE(TC)(std::move(r)));
+}
+
 template <typename TC>
 static ObjRef join(const ObjRef &s, const CallArgs::TPosVector &args, PyVM *vm) {
 	checkArgCountS(Object::STR, args, 1, "join");
-	auto   ito = args[0]->as<IIterable>()->iter(vm); // save a reference to the object
-	auto   it  = ito->as<IIterator>();
-	ObjRef o;
-	if (!it->next(o))
-		return vm->makeFromT(std::basic_string<TC>());
-	ObjRef result = o;
-	OpImp  ops(vm);
+	auto                ito = args[0]->as<IIterable>()->iter(vm); // save a reference to the object
+	auto                it  = ito->as<IIterator>();
+	std::vector<ObjRef> parts;
+	bool                uni = s->type() == Object::USTR;
+	ObjRef              o;
 	while (it->next(o)) {
-		CHECK(o->type == Object::STR || o->type == Object::USTR, "join(): wrong type expected: str or unicode got:" << o->typeName());
-		result = ops.add(result, s);
-		result = ops.add(result, o);
+		CHECK(isStrType(o->type()), "join(): wrong type expected: str or unicode got:" << o->typeName());
+		uni |= o->type() == Object::USTR;
+		parts.push_back(std::move(o));
 	}
-	return result;
+	if (parts.empty())
+		return vm->makeFromT(std::basic_string<TC>());
+	if (parts.size() == 1)
+		return parts[0];
+	if (uni)
+		return joinParts<wchar_t>(s, parts, vm);
+	return joinParts<char>(s, parts, vm);
 }
 
-#ifdef _WINDOWS
-#define PATH_MODIFIER_ STRMOD_PATH
-#else
-#define PATH_MODIFIER_ STRMOD_NONE
-#endif
-
 // to add a string method name,
 // - add it to "string_method_names.txt",
 // - enable it in the build (set "Exclude from build to 'No') doesn't matter which build config
@@ -340,13 +665,13 @@ ObjRef PrimitiveAttrAdapter::stringMethod(const ObjRef &obj, const CallArgs::TPo
 		return m_vm->makeFromT(stringQuery<TC>(obj, args, SO_EQUALS, STRMOD_NONE));
 
 	case STRM_PATHCONTAINS:
-		return m_vm->makeFromT(stringQuery<TC>(obj, args, SO_CONTAINS, PATH_MODIFIER_));
+		return m_vm->makeFromT(stringQuery<TC>(obj, args, SO_CONTAINS, STRMOD_PATH));
 	case STRM_PATHBEGINSWITH:
-		return m_vm->makeFromT(stringQuery<TC>(obj, args, SO_BEGINS, PATH_MODIFIER_));
+		return m_vm->makeFromT(stringQuery<TC>(obj, args, SO_BEGINS, STRMOD_PATH));
 	case STRM_PATHENDSWITH:
-		return m_vm->makeFromT(stringQuery<TC>(obj, args, SO_ENDS, PATH_MODIFIER_));
+		return m_vm->makeFromT(stringQuery<TC>(obj, args, SO_ENDS, STRMOD_PATH));
 	case STRM_PATHEQUALS:
-		return m_vm->makeFromT(stringQuery<TC>(obj, args, SO_EQUALS, PATH_MODIFIER_));
+		return m_vm->makeFromT(stringQuery<TC>(obj, args, SO_EQUALS, STRMOD_PATH));
 
 	case STRM_ICONTAINS:
 		return m_vm->makeFromT(stringQuery<TC>(obj, args, SO_CONTAINS, STRMOD_CASEI));
@@ -371,13 +696,18 @@ ObjRef PrimitiveAttrAdapter::stringMethod(const ObjRef &obj, const CallArgs::TPo
 		return m_vm->makeFromT((size_t)new_st->data());
 	}
 	case STRM_STRIP: {
-		std::basic_string<TC> nonConstS = extract<std::basic_string<TC>>(obj);
+		const std::basic_string<TC> &s = *extractStrPtr<TC>(obj, STRMOD_NONE);
+		size_t                       first, end;
 		if (args.size() == 0) {
-			trimSpaces(nonConstS);
-			return m_vm->makeFromT(nonConstS);
+			trimBounds(s, isTrimSpace<TC>, &first, &end);
+		} else {
+			const std::basic_string<TC> &remove = *extractStrPtr<TC>(args[0], STRMOD_NONE);
+			trimBounds(s, [&](TC c) -> bool { return remove.find(c) != std::basic_string<TC>::npos; }, &first, &end);
 		}
-		strip<TC>(nonConstS, extract<std::basic_string<TC>>(args[0]));
-		return m_vm->makeFromT(nonConstS);
+		// strings are immutable so a string with nothing to strip is its own result
+		if (first == 0 && end == s.size() && obj->type() == Object::typeValue<PSTROBJ_TYPE(TC)>())
+			return obj;
+		return m_vm->alloc(new PSTROBJ_TYPE(TC)(std::basic_string<TC>(s, first, end - first)));
 	}
 	} // switch
 
@@ -386,9 +716,9 @@ ObjRef PrimitiveAttrAdapter::stringMethod(const ObjRef &obj, const CallArgs::TPo
 
 // if anything is unicode, everything should be unicode
 ObjRef PrimitiveAttrAdapter::stringMethodConv(const ObjRef &obj, CallArgs::TPosVector &args) {
-	bool uni = obj->type == Object::USTR;
+	bool uni = obj->type() == Object::USTR;
 	for (auto ait = args.begin(); !uni && ait != args.end(); ++ait)
-		uni |= (*ait)->type == Object::USTR;
+		uni |= (*ait)->type() == Object::USTR;
 	if (!uni)
 		return stringMethod<char>(obj, args);
 	// otherwise, conver all strings to unicode
@@ -409,11 +739,15 @@ ObjRef PrimitiveAttrAdapter::listMethod(const ObjRef &obj, CallArgs::TPosVector
 	}
 	if (m_name == "extend") {
 		checkArgCount(obj, args, 1);
+		if (args[0]->type() == Object::LIST || args[0]->type() == Object::TUPLE) {
+			l->extend(*static_cast<ListObject *>(args[0].get()));
+			return m_vm->makeNone();
+		}
 		auto   ito = args[0]->as<IIterable>()->iter(m_vm); // save the iterator reference
 		auto   it  = ito->as<IIterator>();
 		ObjRef o;
 		while (it->next(o))
-			l->v.push_back(o);
+			l->append(o);
 		return m_vm->makeNone();
 	}
 	THROW("Unknown list method " << m_name);
@@ -453,7 +787,7 @@ ObjRef PrimitiveAttrAdapter::call(Frame &from, Frame &frame, int posCount, int k
 
 	args.posReverse(); // arguments come in reverse order, we can just edit in place since it's not used after.
 
-	switch (m_obj->type) {
+	switch (m_obj->type()) {
 	case Object::STR:
 	case Object::USTR:
 		return stringMethodConv(m_obj, args.pos);
@@ -465,6 +799,6 @@ ObjRef PrimitiveAttrAdapter::call(Frame &from, Frame &frame, int posCount, int k
 		return dictMethod<DictObject>(m_obj, args.pos);
 	// if you add a case here, you also need to at it in adaptedType()
 	default:
-		THROW("Unknown primitive method " << m_name << " of " << Object::typeName(m_obj->type));
+		THROW("Unknown primitive method " << m_name << " of " << Object::typeName(m_obj->type()));
 	}
 };
@@ -13,6 +13,13 @@
 #include <chrono>
 #include <cassert>
 
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #ifdef WIN32
 
 #include <windows.h>
@@ -44,15 +51,95 @@ std::string utf8FromWstr(const std::wstring &s) {
 }
 #else
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <cstring>
+
+// the length of the run of ascii bytes p starts with. checks 16 bytes at a time with SSE2 or 8 with plain
+// 64 bit arithmetic, most of the text that goes through here is ascii
+static size_t asciiPrefix(const unsigned char *p, size_t n) {
+	size_t i = 0;
+#ifdef __SSE2__
+	for (; i + 16 <= n; i += 16) {
+		int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(p + i)));
+		if (mask != 0)
+			return i + __builtin_ctz(mask);
+	}
+#endif
+	for (; i + 8 <= n; i += 8) {
+		uint64_t w;
+		memcpy(&w, p + i, 8);
+		if ((w & 0x8080808080808080ULL) != 0)
+			break;
+	}
+	while (i < n && p[i] < 0x80)
+		++i;
+	return i;
+}
+
+// strict: rejects overlong forms, surrogates and code points above U+10FFFF. wchar_t is UCS-4 here
 bool wstrFromUtf8(const std::string &s, std::wstring *out) {
-	assert("Implement Me" && 0);
-	return false;
+	const unsigned char *p = (const unsigned char *)s.data();
+	size_t               n = s.size();
+	out->clear();
+	out->reserve(n); // never more characters than bytes
+	for (size_t i = 0; i < n;) {
+		size_t a = asciiPrefix(p + i, n - i);
+		out->append(p + i, p + i + a);
+		i += a;
+		if (i == n)
+			break;
+		unsigned c = p[i], len, cp, min;
+		if (c >= 0xc2 && c <= 0xdf) {
+			len = 2, cp = c & 0x1f, min = 0x80;
+		} else if ((c & 0xf0) == 0xe0) {
+			len = 3, cp = c & 0x0f, min = 0x800;
+		} else if (c >= 0xf0 && c <= 0xf4) {
+			len = 4, cp = c & 0x07, min = 0x10000;
+		} else {
+			return false; // stray continuation byte or a lead byte that is always overlong or out of range
+		}
+		if (n - i < len)
+			return false;
+		for (unsigned k = 1; k < len; ++k) {
+			if ((p[i + k] & 0xc0) != 0x80)
+				return false;
+			cp = (cp << 6) | (p[i + k] & 0x3f);
+		}
+		if (cp < min || cp > 0x10ffff || (cp >= 0xd800 && cp <= 0xdfff))
+			return false;
+		out->append(1, (wchar_t)cp);
+		i += len;
+	}
+	return true;
 }
 
+// characters that can't be encoded (surrogates, out of range) become U+FFFD
 std::string utf8FromWstr(const std::wstring &s) {
-	std::string s2;
-	assert("Implement Me" && 0);
-	return s2;
+	std::string out;
+	out.reserve(s.size());
+	for (wchar_t wc : s) {
+		uint32_t c = (uint32_t)wc;
+		if (c < 0x80) {
+			out.push_back((char)c);
+			continue;
+		}
+		if ((c >= 0xd800 && c <= 0xdfff) || c > 0x10ffff)
+			c = 0xfffd;
+		if (c < 0x800) {
+			out.push_back((char)(0xc0 | (c >> 6)));
+		} else if (c < 0x10000) {
+			out.push_back((char)(0xe0 | (c >> 12)));
+			out.push_back((char)(0x80 | ((c >> 6) & 0x3f)));
+		} else {
+			out.push_back((char)(0xf0 | (c >> 18)));
+			out.push_back((char)(0x80 | ((c >> 12) & 0x3f)));
+			out.push_back((char)(0x80 | ((c >> 6) & 0x3f)));
+		}
+		out.push_back((char)(0x80 | (c & 0x3f)));
+	}
+	return out;
 }
 #endif
 
@@ -94,6 +181,35 @@ uint64_t msecTime() {
 
 #ifdef WIN32
 
+ByteSpan mapFile(const std::string &path) {
+	ByteSpan span;
+	HANDLE   file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return span;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		CloseHandle(file);
+		return span;
+	}
+	if (size.QuadPart == 0) { // can't map an empty file
+		CloseHandle(file);
+		span.data = "";
+		return span;
+	}
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file); // the mapping keeps the file open
+	if (mapping == nullptr)
+		return span;
+	void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (view == nullptr)
+		return span;
+	span.data  = (const char *)view;
+	span.size  = (size_t)size.QuadPart;
+	span.owner = std::shared_ptr<void>(view, [](void *v) { UnmapViewOfFile(v); });
+	return span;
+}
+
 void debugBreak() {
 	DebugBreak();
 }
@@ -107,6 +223,32 @@ void consoleSetColor(int col) {
 
 #else
 
+ByteSpan mapFile(const std::string &path) {
+	ByteSpan span;
+	int      fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return span;
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return span;
+	}
+	if (st.st_size == 0) { // can't map an empty file
+		close(fd);
+		span.data = "";
+		return span;
+	}
+	size_t size = (size_t)st.st_size;
+	void  *view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // the mapping keeps the file open
+	if (view == MAP_FAILED)
+		return span;
+	span.data  = (const char *)view;
+	span.size  = size;
+	span.owner = std::shared_ptr<void>(view, [size](void *v) { munmap(v, size); });
+	return span;
+}
+
 void debugBreak() {
 	printf("debugBreak!\n");
 	abort();
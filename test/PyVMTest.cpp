@@ -13,6 +13,7 @@
 #include "PyVM/ObjPool.h"
 #include "PyVM/objects.h"
 #include "PyVM/BufferAccess.h"
+#include "PyVM/StrKernels.h"
 
 #include <iostream>
 #include <fstream>
@@ -47,6 +48,99 @@ TEST(PyVM, pool_object_removal)
     ASSERT_EQ(pool.size(), 0);
 }
 
+TEST(PyVM, pool_objects_of_two_pools)
+{
+    ObjPool<TestObject> pool1, pool2;
+    std::vector<PoolPtr<TestObject>> v1, v2;
+    for (int i = 0; i < 10000; ++i) {
+        v1.push_back(pool1.add(new TestObject(i)));
+        v2.push_back(pool2.add(new TestObject(i)));
+    }
+    v1.resize(10);
+    ASSERT_EQ(pool1.size(), 10);
+    ASSERT_EQ(pool2.size(), 10000);
+    v2.clear();
+    ASSERT_EQ(pool2.size(), 0);
+    v1.clear();
+    ASSERT_EQ(pool1.size(), 0);
+}
+
+TEST(PyVM, pool_epoch_survives_compaction)
+{
+    ObjPool<TestObject> pool;
+    std::vector<PoolPtr<TestObject>> old, young;
+    for (int i = 0; i < 10000; ++i)
+        old.push_back(pool.add(new TestObject(i)));
+    ObjPool<TestObject>::Epoch e(pool);
+    for (int i = 0; i < 10000; ++i)
+        young.push_back(pool.add(new TestObject(-i)));
+    // free most objects so that the registry gets compacted when it grows again
+    old.resize(100);
+    young.resize(100);
+    for (int i = 0; i < 20000; ++i)
+        young.push_back(pool.add(new TestObject(-1)));
+    ASSERT_EQ(pool.size(), 20200);
+
+    int count = 0;
+    bool inOrder = true;
+    pool.foreachSince(e, [&](const PoolPtr<TestObject>& p)->bool {
+        inOrder &= (p.get() == young[count].get());
+        ++count;
+        return true;
+    });
+    EXPECT_EQ(count, 20100);
+    EXPECT_TRUE(inOrder);
+}
+
+// a benchmark as much as a test: the teardown of a heap of cycles used to restart its walk on every removal
+TEST(PyVM, teardown_of_cyclic_heap_is_linear) {
+    const int pairs = 500000;
+    uint64_t  start = msecTime();
+    {
+        PyVM v;
+        for (int i = 0; i < pairs; ++i) {
+            auto a = v.alloct(new ListObject), b = v.alloct(new ListObject);
+            a->append(ObjRef(b));
+            b->append(ObjRef(a));
+        }
+        uint64_t built = msecTime();
+        int      count = v.objPool().size();
+        v.clear();
+        uint64_t cleared = msecTime();
+        std::cout << "built " << count << " objects in " << built - start << " ms, teardown " << cleared - built << " ms" << std::endl;
+        ASSERT_TRUE((cleared - built < (built - start) * 5 + 1000));
+    }
+}
+
+TEST(PyVM, pool_deletes_long_chains_without_recursion) {
+    PyVM v;
+    int  base = v.objPool().size();
+    auto makeChain = [&](int length) {
+        ListObjRef head = v.alloct(new ListObject);
+        for (int i = 1; i < length; ++i) {
+            ListObjRef l = v.alloct(new ListObject);
+            l->append(ObjRef(head));
+            head = l;
+        }
+        return head;
+    };
+    ListObjRef chain = makeChain(300000); // deep enough to overflow the stack if deleted recursively
+    chain.reset();
+    ASSERT_EQ(v.objPool().size(), base);
+    ASSERT_EQ(v.objPool().pendingCount(), 0);
+
+    v.objPool().setDestroyBudget(100);
+    chain = makeChain(1000);
+    chain.reset();
+    // 100 deleted, the next one is freed and waits, it still holds the rest
+    ASSERT_EQ(v.objPool().size(), base + 899);
+    ASSERT_EQ(v.objPool().pendingCount(), 1);
+    ASSERT_EQ(v.objPool().drain(500), 1);
+    ASSERT_EQ(v.objPool().size(), base + 399);
+    ASSERT_EQ(v.objPool().drain(), 0);
+    ASSERT_EQ(v.objPool().size(), base);
+}
+
 TEST(PyVM, stack_operations) {
 
     Stack<int> s;
@@ -67,6 +161,82 @@ TEST(PyVM, stack_operations) {
     ASSERT_THROW(s.pushAt(6, 66), PyException);
 }
 
+TEST(PyVM, stack_does_not_copy_references) {
+    ObjPool<TestObject> pool;
+    PoolPtr<TestObject> p = pool.add(new TestObject(1));
+    Stack<PoolPtr<TestObject>> s;
+    s.push(PoolPtr<TestObject>(p));
+    ASSERT_EQ(p.use_count(), 2);
+    ASSERT_EQ(s.top()->m_x, 1);
+    ASSERT_EQ(s.peek(0).use_count(), 2);
+    PoolPtr<TestObject> q = s.pop();
+    ASSERT_EQ(p.use_count(), 2);
+    ASSERT_EQ(s.size(), 0);
+}
+
+TEST(PyVM, utf8_transcoding) {
+    std::wstring w;
+    std::string  s = "plain ascii text that is longer than sixteen bytes \xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80!";
+    ASSERT_TRUE(wstrFromUtf8(s, &w));
+    ASSERT_EQ(w.size(), 55);
+    ASSERT_TRUE((w[51] == 0xe9 && w[52] == 0x20ac && (uint32_t)w[53] == 0x1f600 && w[54] == L'!'));
+    ASSERT_TRUE((utf8FromWstr(w) == s));
+
+    ASSERT_FALSE(wstrFromUtf8("\xc0\xaf", &w));     // overlong
+    ASSERT_FALSE(wstrFromUtf8("\xed\xa0\x80", &w)); // surrogate
+    ASSERT_FALSE(wstrFromUtf8("\xf4\x90\x80\x80", &w)); // above U+10FFFF
+    ASSERT_FALSE(wstrFromUtf8("ab\xe2\x82", &w));   // truncated
+    ASSERT_FALSE(wstrFromUtf8("\x80", &w));
+}
+
+TEST(PyVM, string_kernels_match_scalar_search) {
+    std::cout << "kernels: " << strKernelsName() << std::endl;
+    std::string hay;
+    for (int i = 0; i < 150; ++i)
+        hay += (char)("aBc-/ \xe9Zz"[i % 9]);
+    hay += "Needle\tEnd";
+    std::string lower = toLower(hay);
+    for (size_t from = 0; from < 40; ++from) {
+        for (size_t len = 0; len < 20; ++len) {
+            std::string needle = toLower(hay.substr(hay.size() - 10 - len % 10, len));
+            size_t expect = lower.find(needle, from);
+            size_t got    = iFindAscii(hay.data() + from, hay.size() - from, needle.data(), needle.size());
+            ASSERT_TRUE((got == (expect == std::string::npos ? expect : expect - from)));
+        }
+        size_t ws = hay.find_first_of(" \t\n\r", from);
+        ASSERT_TRUE((from + findWhitespace(hay.data() + from, hay.size() - from) == (ws == std::string::npos ? hay.size() : ws)));
+        ASSERT_TRUE(iEqualsAscii(hay.data() + from, lower.data() + from, hay.size() - from));
+    }
+    ASSERT_FALSE(iEqualsAscii("\xc9", "\xe9", 1)); // folding is ascii only
+    ASSERT_TRUE((iFindAscii(hay.data(), hay.size(), "needlx", 6) == std::string::npos));
+}
+
+TEST(PyVM, names_are_interned_atoms) {
+    Name a("some_name"), b(std::string("some_") + "name");
+    ASSERT_TRUE((a.atom() == b.atom()));
+    ASSERT_TRUE((a == "some_name"));
+    ASSERT_TRUE((Atom::find("never_interned_name") == nullptr));
+
+    NameDict d;
+    const int n = 40;
+    for (int i = 0; i < n; ++i)
+        d[Name("n" + std::to_string(i))];
+    for (int i = 0; i < n; i += 2)
+        ASSERT_EQ(d.erase("n" + std::to_string(i)), 1);
+    ASSERT_EQ(d.erase("never_interned_name"), 0);
+    d["n0"];
+    ASSERT_EQ(d.size(), n / 2 + 1);
+    ASSERT_TRUE((Atom::find("never_interned_name") == nullptr));
+    // insertion order is kept across erase and rehash
+    std::vector<std::string> order;
+    for (auto it = d.begin(); it != d.end(); ++it)
+        order.push_back(it->first);
+    ASSERT_EQ(order.front(), "n1");
+    ASSERT_EQ(order.back(), "n0");
+    ASSERT_TRUE((d.find("n3") != d.end()));
+    ASSERT_TRUE((d.find("n4") == d.end()));
+}
+
 
 
 class PyVMTest : public Test 
@@ -249,7 +419,15 @@ TEST_F(PyVMTest, builtin_types_and_funcs)
     EXPECT_NO_THROW_PYS( vm->call("test_module.testGlobalInClass"));
 
     EXPECT_NO_THROW_PYS( vm->call("test_module.testDictCollision"));
+    EXPECT_NO_THROW_PYS( vm->call("test_module.testDictOrder"));
+    EXPECT_NO_THROW_PYS( vm->call("test_module.testDictKeyKinds"));
+    EXPECT_NO_THROW_PYS( vm->call("test_module.testCallTemps"));
+    EXPECT_NO_THROW_PYS( vm->call("test_module.testInplaceAdd"));
+    EXPECT_NO_THROW_PYS( vm->call("test_module.testStringBuilder"));
+    EXPECT_NO_THROW_PYS( vm->call("test_module.testPatternMatcher"));
+    EXPECT_NO_THROW_PYS( vm->call("test_module.testGlobMatcher"));
     EXPECT_NO_THROW_PYS( vm->call("test_module.testXrange"));
+    EXPECT_NO_THROW_PYS( vm->call("test_module.testListStrategies"));
 }
 
 
@@ -333,6 +511,131 @@ TEST_F(PyVMTest, raise_exception) {
 
 
 
+TEST_F(PyVMTest, list_strategies) {
+    ObjRef r = vm->call("test_module.testListStrategies");
+    ListObjRef l = checked_cast<ListObject>(r);
+    ASSERT_EQ(l->strategy(), ListObject::INTS);
+    ASSERT_TRUE((extract<std::vector<int>>(r) == std::vector<int>({ 3, 1, 2 })));
+    ASSERT_TRUE((extract<std::vector<double>>(r) == std::vector<double>({ 3, 1, 2 })));
+    l->append(vm->makeFromT(2.5));
+    ASSERT_EQ(l->strategy(), ListObject::OBJECTS);
+    ASSERT_EQ(l->size(), 4);
+    ASSERT_EQ(extract<int>(l->at(0)), 3);
+    ASSERT_EQ(extract<double>(l->at(3)), 2.5);
+
+    // lists made by C++ code keep their objects
+    ListObjRef c = vm->alloct(new ListObject);
+    c->append(vm->makeFromT(1));
+    ASSERT_EQ(c->strategy(), ListObject::OBJECTS);
+    c->allowUnboxed(vm.get());
+    ASSERT_EQ(c->strategy(), ListObject::INTS);
+
+    std::vector<int64_t> v;
+    for (int i = 0; i < 37; ++i)
+        v.push_back((int64_t)(i + 1) << 32 | 5);
+    for (int i = 0; i < 37; ++i) {
+        ASSERT_EQ(findInt64(v.data(), v.size(), v[i]), (size_t)i);
+        ASSERT_EQ(findInt64(v.data() + i, v.size() - i, 5), v.size() - i); // the low half alone is no match
+    }
+}
+
+TEST_F(PyVMTest, memory_limits) {
+    int64_t base = vm->memoryUsed();
+    ObjRef r = vm->call("test_module.memoryGrow", 1000);
+    int64_t used = vm->memoryUsed() - base;
+    ASSERT_TRUE((used > 1000 * (8 + 24 + 4))); // the list, the dict entries and the string
+    r.reset();
+    ASSERT_EQ(vm->memoryUsed(), base);
+
+    std::vector<int64_t> soft;
+    vm->setMemoryLimits(base + used / 2, base + used * 4, [&](int64_t u) { soft.push_back(u); });
+    r = vm->call("test_module.memoryGrow", 1000);
+    ASSERT_EQ(soft.size(), (size_t)1); // once until the limits are set again
+    ASSERT_TRUE((soft[0] > base + used / 2));
+    r.reset();
+
+    vm->setMemoryLimits(0, base + used / 2);
+    bool thrown = false;
+    try {
+        vm->call("test_module.memoryGrow", 1000);
+    } catch (const PyException &e) {
+        thrown = std::string(e.what()).find("MemoryError") != std::string::npos;
+    }
+    ASSERT_TRUE(thrown);
+    ASSERT_EQ(vm->memoryUsed(), base); // whatever was made is freed by the unwinding
+    vm->setMemoryLimits(0, 0);
+    ASSERT_EQ(checked_cast<TupleObject>(vm->call("test_module.memoryGrow", 10))->size(), 3);
+
+    // an object is accounted with the size of its own type, whatever pointer it's allocated through
+    base = vm->memoryUsed();
+    Object *o = new InstanceObject(ClassObjRef());
+    ObjRef i = vm->alloc(o);
+    EXPECT_EQ(o->objectSize(), sizeof(InstanceObject));
+    EXPECT_EQ(vm->memoryUsed() - base, (int64_t)(sizeof(InstanceObject) + o->payloadSize()));
+    i.reset();
+    EXPECT_EQ(vm->memoryUsed(), base);
+}
+
+// what str dicts, attributes and the caches of a str allocate is counted as it grows
+TEST_F(PyVMTest, memory_counts_payloads) {
+    ObjRef v = vm->makeFromT(1);
+    auto d = vm->alloct(new StrDictObject);
+    int64_t base = vm->memoryUsed();
+    for (int i = 0; i < 50; ++i)
+        d->setSubscr(vm->makeFromT("k" + std::to_string(i)), v);
+    EXPECT_TRUE((d->payloadSize() > 50 * sizeof(NameDict::value_type)));
+    EXPECT_EQ(vm->memoryUsed() - base, (int64_t)d->payloadSize());
+
+    InstanceObjRef a = mod->emptyClass("PayloadTest")->createInstance();
+    base = vm->memoryUsed();
+    for (int i = 0; i < Shape::MAX_SLOTS + 8; ++i) { // slots, then a dict
+        a->setattr(Name("p" + std::to_string(i)), v);
+        EXPECT_EQ(vm->memoryUsed() - base, (int64_t)a->payloadSize());
+    }
+    EXPECT_TRUE((a->m_dict != nullptr));
+
+    auto s = vm->alloct(new StrObject(std::string(100, 'A')));
+    base = vm->memoryUsed();
+    s->getStr(STRMOD_CASEI);
+    s->getWStr(STRMOD_PATH);
+    EXPECT_TRUE((vm->memoryUsed() - base > 100 * 3));
+    EXPECT_EQ(vm->memoryUsed() - base, (int64_t)(s->payloadSize() - strPayloadSize(s->v)));
+    s->changed();
+    EXPECT_EQ(vm->memoryUsed(), base);
+}
+
+TEST_F(PyVMTest, dict_key_kinds) {
+    ObjDict d(vm.get());
+    ASSERT_EQ(d.keyKind(), ObjDict::NO_KEYS);
+    d[vm->makeFromT(-1)] = vm->makeFromT(1);
+    d[vm->makeFromT(-2)] = vm->makeFromT(2);
+    ASSERT_EQ(d.keyKind(), ObjDict::INT_KEYS);
+    ASSERT_EQ(d.size(), (size_t)2);
+    ASSERT_EQ(extract<int>(d.find(vm->makeFromT(-1))->second), 1);
+    ASSERT_EQ(extract<int>(d.find(vm->makeFromT(-2))->second), 2);
+    d[vm->makeFromT("x")] = vm->makeFromT(3);
+    ASSERT_EQ(d.keyKind(), ObjDict::ANY_KEYS);
+    ASSERT_EQ(extract<int>(d.find(vm->makeFromT(-1))->second), 1);
+    d.clear();
+    d[vm->makeFromT("x")] = vm->makeFromT(3);
+    ASSERT_EQ(d.keyKind(), ObjDict::STR_KEYS);
+    ASSERT_TRUE((d.find(vm->makeFromT(std::string("x"))) != d.end()));
+    ASSERT_TRUE((d.find(vm->makeFromT("y")) == d.end()));
+}
+
+TEST_F(PyVMTest, call_temps_are_marked_at_load) {
+    auto countMarks = [&](const char *func) {
+        auto f = checked_cast<FuncObject>(vm->getModule("test_module")->attr(func));
+        const auto &marks = f->m_code->m_callTemps;
+        return (int)std::count(marks.begin(), marks.end(), true);
+    };
+    ASSERT_EQ(countMarks("callTempsLoop"), 3); // c.inc, s.strip, c.get
+    ASSERT_EQ(countMarks("callTempsEscape"), 4); // the 4 calls on c in the return, not c.get in the list or s.strip
+    int objCount = vm->objPool().size();
+    ASSERT_EQ(extract<int>(vm->call("test_module.callTempsLoop", 1000)), 4000);
+    ASSERT_EQ(vm->objPool().size(), objCount);
+}
+
 TEST_F(PyVMTest, numbers_conversion)
 {
     int HKLM_SIGNED_VAL = 0x80000002; // normal HKEY_LOCAL_MACHINE is unsigned so it doesn't extend well in 32 bit compile
@@ -466,6 +769,171 @@ TEST_F(PyVMTest, StateClearer_on_leak) {
 
 }
 
+TEST_F(PyVMTest, StateClearer_clears_in_steps) {
+    int objCount = vm->objPool().size();
+    ListObjRef after;
+    {
+        StateClearer sc(vm.get());
+        for (int i = 0; i < 1000; ++i) {
+            auto a = vm->alloct(new ListObject), b = vm->alloct(new ListObject);
+            a->append(ObjRef(a));
+            b->append(ObjRef(a));
+        }
+        sc.close();
+        // created between slices, not part of the scope
+        after = vm->alloct(new ListObject);
+        ASSERT_FALSE(sc.step(100));
+        after->append(ObjRef(vm->alloct(new ListObject)));
+        int steps = 1;
+        while (!sc.step(100))
+            ++steps;
+        ASSERT_TRUE((steps >= 10 && steps <= 20));
+        ASSERT_EQ(vm->objPool().size(), objCount + 2);
+        ASSERT_TRUE(sc.step(std::chrono::steady_clock::now()));
+    }
+    ASSERT_EQ(after->size(), 1);
+    after.reset();
+    ASSERT_EQ(vm->objPool().size(), objCount);
+}
+
+TEST_F(PyVMTest, Region_frees_scope_objects) {
+    int refs = vm->objPool().countRefs();
+    int objCount = vm->objPool().size();
+    {
+        PyVM::Region r(vm.get());
+        vm->call("test_module.testMem", false);
+        EXPECT_EQ(r.release(), 0);
+    }
+    EXPECT_EQ(vm->objPool().countRefs(), refs);
+    EXPECT_EQ(vm->objPool().size(), objCount);
+}
+
+TEST_F(PyVMTest, Region_keeps_escaped_objects) {
+    int objCount = vm->objPool().size();
+    {
+        PyVM::Region r(vm.get());
+        vm->call("test_module.testRegionEscape");
+        EXPECT_EQ(r.release(), 1); // only the list in keptRef
+    }
+    EXPECT_EQ(vm->objPool().size(), objCount + 1);
+    ObjRef kept = mod->getGlobal("keptRef");
+    ASSERT_EQ(kept->type(), Object::LIST);
+    EXPECT_EQ(stdstr(kept), "[1, 2]"); // not cleared
+    kept.reset();
+    mod->addGlobal(vm->makeNone(), "keptRef");
+    EXPECT_EQ(vm->objPool().size(), objCount);
+}
+
+TEST_F(PyVMTest, constants_are_immortal_and_shared) {
+    ObjRef a = vm->call("test_module.constTuple1");
+    int objCount = vm->objPool().size();
+    ObjRef b = vm->call("test_module.constTuple2");
+    EXPECT_EQ(vm->objPool().size(), objCount);
+    EXPECT_EQ(a.get(), b.get());
+    EXPECT_TRUE(a->count.immortal());
+    EXPECT_EQ(stdstr(a), "['const', 2.5]");
+}
+
+// constant tuples hold the constants they're made of. run with a sanitizer to see the order they're freed in
+TEST_F(PyVMTest, constants_are_freed_after_the_tuples_that_hold_them) {
+    std::unique_ptr<PyVM> v(new PyVM);
+    v->importPycFile(s_path + "imped_module.pyc");
+    ASSERT_FALSE(v->importPycFile(s_path + "test_module.pyc").isNull());
+    EXPECT_EQ(stdstr(v->call("test_module.constTuple1")), "['const', 2.5]");
+    v.reset();
+}
+
+// parsing the same code again makes no new constants, a parse that fails takes back the ones it made
+TEST_F(PyVMTest, constants_are_made_once_per_vm) {
+    std::unique_ptr<PyVM> v(new PyVM);
+    ByteSpan pyc = mapFile(s_path + "imped_module2.pyc");
+    ASSERT_TRUE((pyc.data != nullptr && pyc.size > 20));
+    ASSERT_THROW(CodeDefinition::parsePyc(pyc.data, pyc.size - 20, v.get(), true), PyException);
+    EXPECT_EQ(v->constants().size(), 0);
+    int64_t used = v->memoryUsed();
+
+    CodeDefinition::parsePyc(pyc.data, pyc.size, v.get(), true);
+    size_t consts = v->constants().size();
+    EXPECT_TRUE((consts > 0));
+    EXPECT_TRUE((v->memoryUsed() > used));
+    used = v->memoryUsed();
+    CodeDefinition::parsePyc(pyc.data, pyc.size, v.get(), true);
+    EXPECT_EQ(v->constants().size(), consts);
+    EXPECT_EQ(v->memoryUsed(), used);
+}
+
+// every cut of a pyc is an error that leaves nothing behind, wherever the parse stops
+TEST_F(PyVMTest, parse_of_cut_pyc_throws_cleanly) {
+    std::unique_ptr<PyVM> v(new PyVM);
+    ByteSpan pyc = mapFile(s_path + "test_module.pyc");
+    ASSERT_TRUE((pyc.data != nullptr));
+    int objCount = v->objPool().size();
+    int64_t used = v->memoryUsed();
+    for (size_t n = 0; n < pyc.size; ++n)
+        ASSERT_THROW(CodeDefinition::parsePyc(pyc.data, n, v.get(), true), PyException);
+    EXPECT_EQ(v->constants().size(), 0);
+    EXPECT_EQ(v->objPool().size(), objCount);
+    EXPECT_EQ(v->memoryUsed(), used);
+}
+
+TEST_F(PyVMTest, CycleCollector_frees_cycles) {
+    vm->collector().collect(); // cycles left over by earlier tests
+    int objCount = vm->objPool().size();
+    vm->call("test_module.testMem", false); // leaves a cycle behind
+    EXPECT_TRUE((vm->objPool().size() > objCount));
+    EXPECT_TRUE((vm->collector().collect() > 0));
+    EXPECT_EQ(vm->objPool().size(), objCount);
+    EXPECT_EQ(vm->collector().collect(), 0);
+}
+
+TEST_F(PyVMTest, CycleCollector_steps_over_pool) {
+    vm->collector().collect();
+    int objCount = vm->objPool().size();
+    vm->call("test_module.testMem", false);
+    // enough small steps to wrap around the whole pool
+    for (int i = 0; i < 2 * objCount / 16 + 10; ++i)
+        vm->collector().step(32);
+    EXPECT_EQ(vm->objPool().size(), objCount);
+}
+
+TEST_F(PyVMTest, CycleCollector_auto_steps_between_calls) {
+    vm->collector().collect();
+    vm->collector().setAutoStep(1, 1 << 20);
+    vm->call("test_module.testMem", false); // leaves a cycle behind
+    int objCount = vm->objPool().size();
+    vm->call("test_module.testMem", false); // the cycle of the first call is freed before this one runs
+    EXPECT_EQ(vm->objPool().size(), objCount);
+    vm->collector().setAutoStep(0, 0);
+    EXPECT_TRUE((vm->collector().collect() > 0));
+}
+
+TEST_F(PyVMTest, instances_share_attribute_shapes) {
+    ClassObjRef cls = mod->emptyClass("ShapeTest");
+    InstanceObjRef a = cls->createInstance(), b = cls->createInstance(), c = cls->createInstance();
+    a->setattr("x", vm->makeFromT(1));
+    a->setattr("y", vm->makeFromT(2));
+    b->setattr("x", vm->makeFromT(3));
+    b->setattr("y", vm->makeFromT(4));
+    c->setattr("y", vm->makeFromT(5));
+    c->setattr("x", vm->makeFromT(6));
+    EXPECT_TRUE((a->m_shape == b->m_shape));
+    EXPECT_TRUE((a->m_shape != c->m_shape));
+    EXPECT_EQ(extract<int>(b->attr("y")), 4);
+    EXPECT_EQ(extract<int>(c->attr("x")), 6);
+    EXPECT_TRUE(a->attr("z").isNull());
+
+    // more attributes than a shape holds moves the instance to a dictionary
+    for (int i = 0; i < Shape::MAX_SLOTS + 8; ++i)
+        a->setattr(Name("attr" + std::to_string(i)), vm->makeFromT(i));
+    EXPECT_TRUE((a->m_shape == nullptr));
+    EXPECT_EQ(extract<int>(a->attr("y")), 2);
+    EXPECT_EQ(extract<int>(a->attr("attr39")), 39);
+    int count = 0;
+    a->forEachOwnAttr([&](const Name&, const ObjRef&) { ++count; });
+    EXPECT_EQ(count, Shape::MAX_SLOTS + 10);
+    mod->delGlobal("ShapeTest");
+}
+
 class CClass {
 public:
     CClass(PyVM*)    {ctorWasCalled = true;	}
@@ -547,11 +1015,31 @@ TEST_F(PyVMTest, testMapItter){
     EXPECT_NO_THROW_PYS( vm->call("test_module.testMapItter") );
 }
 
+TEST_F(PyVMTest, lookups_by_data_dont_intern) {
+    auto d = vm->alloct(new StrDictObject);
+    size_t atoms = Atom::count();
+    ObjRef key = vm->makeFromT(std::string("neverAName"));
+    EXPECT_THROW(d->getSubscr(key, vm.get()), PyException);
+    EXPECT_TRUE(d->pop(key).isNull());
+    EXPECT_EQ(d->v.size(), 0);
+    EXPECT_NO_THROW_PYS( vm->call("test_module.testComputedNames", 10) );
+    EXPECT_TRUE(vm->findName("neverAName").isNull());
+    EXPECT_EQ(Atom::count(), atoms);
+
+    d->setSubscr(key, vm->makeFromT(1)); // a store interns
+    EXPECT_EQ(Atom::count(), atoms + 1);
+    EXPECT_TRUE((vm->findName("neverAName") == Name("neverAName")));
+    EXPECT_TRUE((vm->name("neverAName") == Name("neverAName")));
+    EXPECT_EQ(extract<int>(d->getSubscr(key, vm.get())), 1);
+    EXPECT_EQ(extract<int>(d->pop(key)), 1);
+    EXPECT_EQ(d->v.size(), 0);
+}
+
 TEST_F(PyVMTest, testStrMapItter){	
     StrDictObject* objDict = new StrDictObject;
     auto dictObjRef =  vm->alloc(objDict);
-	objDict->v.insert(std::pair<std::string,ObjRef>("a",vm->makeFromT((int)42) ));
-	objDict->v.insert(std::pair<std::string,ObjRef>("c",vm->makeFromT((int)43) ));
+	objDict->v.insert(NameDict::value_type(Name("a"),vm->makeFromT((int)42) ));
+	objDict->v.insert(NameDict::value_type(Name("c"),vm->makeFromT((int)43) ));
 
     EXPECT_NO_THROW_PYS( vm->call("test_module.testStrMapItter",dictObjRef) );
 }
@@ -619,6 +1107,20 @@ TEST_F(PyVMTest, import_callback) {
 
 
 
+TEST_F(PyVMTest, import_span_callback) {
+	vm->setImportSpanCallback([](const std::string& name) {
+		ByteSpan pyc = mapFile("./" + name + ".pyc");
+		CHECK(pyc.data != nullptr, "Failed mapping module " << name);
+		return std::make_pair(pyc, true);
+	});
+	EXPECT_NO_THROW_PYS( vm->call("test_module.testImportCallback"));
+
+	// a cut pyc is an error, never a read past its end
+	ByteSpan pyc = mapFile("./imped_module2.pyc");
+	ASSERT_TRUE((pyc.data != nullptr && pyc.size > 20));
+	ASSERT_THROW(CodeDefinition::parsePyc(pyc.data, pyc.size - 20, vm.get(), true), PyException);
+}
+
 void testMemLeak(PyVM* vm) {
     for(int i = 0; i < 100; ++i) {
         {
@@ -279,3 +279,36 @@ TEST(VarArray, insert_allDestroyed)
 }
 
 
+
+TEST(VarArray, moveOnly_neverCopied)
+{
+	using int_ptr = std::unique_ptr<int>;
+	VarArray<int_ptr, 2> v;
+	for (int i = 0; i < 5; ++i)
+		v.push_back(int_ptr(new int(i)));
+	v.emplace_back(new int(5));
+	v.insert(v.begin(), int_ptr(new int(-1)));
+	ASSERT_EQ(7, v.size());
+	ASSERT_EQ(-1, *v[0]);
+	ASSERT_EQ(5, *v[6]);
+
+	VarArray<int_ptr, 2> moved(std::move(v));
+	ASSERT_EQ(0, v.size());
+	ASSERT_EQ(7, moved.size());
+	for (int i = 0; i < 5; ++i)
+		moved.pop_back();
+	ASSERT_EQ(2, moved.size());
+	ASSERT_EQ(0, *moved[1]);
+
+	v = std::move(moved);
+	ASSERT_EQ(2, v.size());
+	ASSERT_EQ(-1, *v[0]);
+	ASSERT_EQ(0, moved.size());
+
+	VarArray<int_ptr, 2> small; // elements in the static buffer
+	small.push_back(int_ptr(new int(42)));
+	moved = std::move(small);
+	ASSERT_EQ(1, moved.size());
+	ASSERT_EQ(42, *moved[0]);
+	ASSERT_EQ(0, small.size());
+}
@@ -319,7 +319,7 @@ def testIs():
     b = 2
     FALSE(b is None)
     TRUE(b is not None)
-    FALSE(b is 3-1) # different from CPython, for int < 256
+    TRUE(b is 3-1) # constants are shared in a module, like in CPython
     b += 1
     a = 'bla'
     FALSE(a is b)
@@ -412,6 +412,12 @@ def testUnicode():
     FALSE(a.contains('Ll'))
     TRUE(u'xxx' == 'xxx')
     TRUE(u'a' < 'b')
+    TRUE('b' >= u'a')
+    FALSE('abc' == u'ab')
+    TRUE('ll' in u'hello')
+    TRUE(u'ell' in 'hello')
+    FALSE('x' in u'hello')
+    EQ(u'\U0001F600\u00e9' + 'x', u'\U0001F600\u00e9x')
     EQ('ababa'.split(u'a'), [u'', u'b', u'b', u''])
     EQ(u'ababa'.split('a'), [u'', u'b', u'b', u''])
     EQ('ababa'.split(u'a', False), [u'b', u'b'])
@@ -623,6 +629,21 @@ def testMem(doLeakRef):
     b = [a,1]
     a[0] = b
     return a
+
+keptRef = None
+def testRegionEscape():
+    # garbage with a cycle and one object that escapes to a global
+    a = [0,0]
+    b = [a,1]
+    a[0] = b
+    global keptRef
+    keptRef = [a, 2]
+    keptRef[0] = 1
+
+def constTuple1():
+    return ('const', 2.5)
+def constTuple2():
+    return ('const', 2.5)
     
 def testImport():
     imped_module.hello()
@@ -1008,6 +1029,20 @@ def testGetAttr():
     #default from normal attribute
     EQ(getattr(b, "blabla", 902), 902)
 
+class EchoAttr:
+    def __getattr__(self, name):
+        return name
+
+# names made at runtime are looked up without interning them
+def testComputedNames(n):
+    e = EchoAttr()
+    b = NoAttCls()
+    for i in xrange(n):
+        name = "computed" + str(i)
+        FALSE(hasattr(b, name))
+        EQ(getattr(b, name, 1), 1)
+        EQ(getattr(e, name), name)
+
 def testLogger():
 	#simple validation, maybe add validation that logs are really written
     logging.debug('a', 5, 'b')
@@ -1043,6 +1078,12 @@ def testStringComparisons():
     FALSE('blablak'.equals('blabla'))
     TRUE('blablA'.iEquals('Blabla'))
     TRUE('blabla'.iEquals('blabla'))
+    p = '/usr/Local/Share/Applications/Some Vendor/Product-Name/bin/Launcher.EXE'
+    TRUE(p.iContains('some vendor/PRODUCT-name'))
+    FALSE(p.iContains('some vendor/PRODUCT-namex'))
+    TRUE(p.iEndsWith('/launcher.exe'))
+    TRUE(p.iEquals(p.lower()))
+    FALSE(p.iEquals(p.lower()[:-1] + '!'))
     
     #windows only
 #    TRUE('c:/bla/bla'.pathEquals(r'C:\bla\BLA'))
@@ -1272,6 +1313,26 @@ def testSubstr():
     EQ(s[-1:0:-2], "gec")
     
     EQ(s[-20:20:2], "aceg")
+    EQ(s[::-1], "gfedcba")
+    TRUE(s[:] is s)
+    TRUE(s[::] is s)
+    EQ(s[3:100], "defg")
+    EQ(s[100:], "")
+    t = (1, 2, 3)
+    TRUE(t[:] is t)
+    EQ(t[1:], [2, 3])
+    l = [1, 2, 3]
+    FALSE(l[:] is l)
+    EQ(l[1:], [2, 3])
+    EQ("a,,b".split(","), ["a", "", "b"])
+    EQ("a,,b".split(",", False), ["a", "b"])
+    EQ(" a  b\tc ".split(), ["a", "b", "c"])
+    EQ(u"x--y".split("--"), [u"x", u"y"])
+    EQ("  ab ".strip(), "ab")
+    EQ("xxabx".strip("x"), "ab")
+    st = "ab"
+    TRUE(st.strip() is st)
+    EQ(u" ab".strip(), u"ab")
 
     # everything frob above, just with an extra colon
     EQ(s[::], "abcdefg")
@@ -1324,6 +1385,196 @@ def testDictCollision():
     EQ(d['a'], 1)
     EQ(d[h], 2)
 
+def testDictKeyKinds():
+    d = {}
+    for i in xrange(-3, 200):
+        d[i] = i * 2
+    EQ(d[-1], -2)
+    EQ(d[-2], -4)
+    EQ(d[1.0], 2)
+    TRUE(199 in d)
+    FALSE(200 in d)
+    FALSE('1' in d)
+    d.pop(-1)
+    FALSE(-1 in d)
+    EQ(d[-2], -4)
+    s = {'a': 1, 'b': 2}
+    EQ(s[u'a'], 1)
+    s[3] = 'c' # any keys from now on
+    EQ(s['b'], 2)
+    EQ(s[3], 'c')
+
+class CallTemps:
+    def __init__(self):
+        self.n = 0
+    def inc(self, k):
+        self.n = self.n + k
+        return self
+    def get(self):
+        return self.n
+
+def callTempsLoop(n):
+    c = CallTemps()
+    s = ' abc '
+    t = 0
+    for i in xrange(n):
+        c.inc(1)
+        t += len(s.strip())
+    return c.get() + t
+
+def callTempsEscape(c, s):
+    keep = [c.get] # an argument, not a call temp
+    f = s.strip
+    return c.inc(c.inc(1).get()).get(), keep[0](), f()
+
+def testCallTemps():
+    EQ(callTempsLoop(10), 40)
+    c = CallTemps()
+    EQ(callTempsEscape(c, ' x '), (2, 2, 'x'))
+    s = ''
+    for i in xrange(5):
+        n = s.startswith('a')
+        s += 'a'
+    EQ(s, 'aaaaa')
+
+def memoryGrow(n):
+    l = []
+    d = {}
+    s = ''
+    for i in xrange(n):
+        l.append(i)
+        d[i] = i
+        s += 'abcd'
+    return l, d, s
+
+def testStringBuilder():
+    b = StringBuilder()
+    EQ(b.getvalue(), '')
+    b.reserve(100)
+    for i in xrange(3):
+        b.append('ab')
+    b.write('c')
+    v = b.getvalue()
+    EQ(v, 'abababc')
+    TRUE(b.getvalue() is v)
+    b.append(v)
+    EQ(v, 'abababc')
+    EQ(b.getvalue(), 'abababcabababc')
+    EQ(b.size(), 14)
+    EQ(','.join(['a', 'b', u'c']), u'a,b,c')
+
+PATTERNS = compile_patterns(['he', 'she', 'his', 'hers'])
+
+def testPatternMatcher():
+    TRUE(PATTERNS.matches('ushers'))
+    FALSE(PATTERNS.matches('uSHErs'))
+    EQ(PATTERNS.search('ushers'), 'she')
+    EQ(PATTERNS.search('xyz'), None)
+    EQ(PATTERNS.findall('ushers'), [(1, 'she'), (2, 'he'), (2, 'hers')])
+    EQ(PATTERNS.findall(u'ushers'), [(1, 'she'), (2, 'he'), (2, 'hers')])
+    m = compile_patterns(['system32', u'\u05d0\u05d1', 'Temp'], casei=True)
+    TRUE(m.matches('C:\\Windows\\SYSTEM32\\cmd.exe'))
+    TRUE(m.matches(u'c:\\temp\\x'))
+    TRUE(m.matches(u'x\u05d0\u05d1y'))
+    FALSE(m.matches(u'x\u05d0y'))
+    EQ(m.patternCount(), 3)
+    EQ(compile_patterns(('aa',)).findall('aaaa'), [(0, 'aa'), (1, 'aa'), (2, 'aa')])
+
+def testGlobMatcher():
+    rules = GlobMatcher(['/usr/**/lib*.so', '/etc/[a-c]?.conf', '/etc/*', '/home/*/.ssh/**', '/opt/[!x]*/bin/run', '/usr/lib/libc.so'])
+    EQ(rules.ruleCount(), 6)
+    EQ(rules.matchall('/usr/lib/libc.so'), [0, 5])
+    EQ(rules.match('/usr/libfoo.so'), 0)
+    EQ(rules.match('/usr/a/b/c/libfoo.so'), 0)
+    FALSE(rules.matches('/usr/a/foo.so'))
+    EQ(rules.matchall('/etc/b1.conf'), [1, 2])
+    EQ(rules.matchall('/etc/d1.conf'), [2])
+    FALSE(rules.matches('/etc/a/b'))
+    TRUE(rules.matches(u'/home/joe/.ssh'))
+    TRUE(rules.matches('/home/joe//.ssh/keys/id_rsa'))
+    FALSE(rules.matches('/home/.ssh/id_rsa'))
+    TRUE(rules.matches('/opt/app/bin/run'))
+    FALSE(rules.matches('/opt/xapp/bin/run'))
+    EQ(GlobMatcher([u'a[b/c']).match('a[b/c'), 0)
+    TRUE('/usr//lib/libc.so'.pathEquals('/usr/lib/libc.so'))
+    TRUE('/usr//lib/libc.so'.pathBeginsWith(u'/usr/lib'))
+
+def testInplaceAdd():
+    s = 'a'
+    t = s
+    for i in xrange(3):
+        s += 'b'
+    s = s + 'c'
+    EQ(s, 'abbbc')
+    EQ(t, 'a')
+    d = {s: 1}
+    k = s
+    s += 'd'
+    EQ(d['abbbc'], 1)
+    EQ(k, 'abbbc')
+    u = u'x'
+    u += 'y'
+    EQ(u, u'xy')
+    l = [1]
+    m = l
+    l += [2]
+    l += (3,)
+    l += l
+    EQ(m, [1, 2, 3, 1, 2, 3])
+    EQ([1] + [2], [1, 2])
+    EQ((1,) + (2,), (1, 2))
+
+def testDictOrder():
+    d = {}
+    for i in xrange(0, 1000, 8): # same low bits, all collide on the first probe
+        d[i] = str(i)
+    for i in xrange(0, 1000, 16):
+        d.pop(i)
+    d[u'x'] = 1
+    EQ(len(d), 63)
+    EQ(d['x'], 1)
+    TRUE(8 in d)
+    FALSE(16 in d)
+    EQ(d.keys()[0], 8)
+    EQ(d.keys()[-1], 'x')
+    EQ(d[992 - 8], '984')
+
+def testListStrategies():
+    l = [x * 2 for x in xrange(100)]
+    TRUE(198 in l)
+    FALSE(199 in l)
+    TRUE(4.0 in l)
+    FALSE('4' in l)
+    EQ(l[3], 6)
+    EQ(l[-1], 198)
+    EQ(l[2:5], [4, 6, 8])
+    EQ(l[::50], [0, 100])
+    l[0] = 7
+    EQ(l[0], 7)
+    l += [1, 2]
+    EQ(len(l), 102)
+    EQ(l.pop(101), 2)
+    l.append('x') # no longer only ints
+    EQ(l[-1], 'x')
+    EQ(l[-2], 1)
+    TRUE(198 in l)
+    f = [0.5, 1.5]
+    f.extend([2.0])
+    TRUE(2 in f)
+    EQ(f, [0.5, 1.5, 2.0])
+    f[1] = None
+    EQ(f, [0.5, None, 2.0])
+    m = [1, 2] + [3.5]
+    EQ(m, [1, 2, 3.5])
+    n = []
+    n.extend(xrange(3))
+    EQ(n + n, [0, 1, 2, 0, 1, 2])
+    s = 0
+    for x in n:
+        s += x
+    EQ(s, 3)
+    return [3, 1, 2]
+
 def mkList(r):
     l = []
     for a in r: